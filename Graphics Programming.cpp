@@ -2,6 +2,17 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
@@ -12,56 +23,171 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include "camerapath.h"
+#include "headless.h"
+#include "memorytracker.h"
+#include "profiler.h"
 #include "model.h"
+#include "rendergraph.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+#include "shader.h"
+#include "softwareocclusion.h"
+#include "spsc.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 const int WIDTH = 1280;
 const int HEIGHT = 720;
 
-void createGeometry(GLuint& vao, GLuint& EBO, int& size, int& numTriangles);
 void createShaders();
-void createProgram(GLuint& programID, const char* vertex, const char* fragment);
+void renderFrame();
+void beginSection(const char* name);
+void endSection();
+void createSceneShaders();
+void createProgram(GLuint& programID, const char* vertex, const char* fragment, const std::vector<std::string>& defines);
 GLuint loadTexture(const char* path, int comp = 0);
+void createDefaultTextures();
 void renderSkyBox();
 void renderTerrain();
-void renderModel(Model* model, glm::vec3 pos, glm::vec3 rot, glm::vec3 scale);
-void createFrameBuffer(int width, int height, unsigned int& frameBufferID, unsigned int& colorBufferID, unsigned int& depthBufferID);
-void renderToBuffer(unsigned int frameBufferTo, unsigned int colorBufferFrom, unsigned int shader);
+struct Prop;
+Prop makeProp(Model* model, glm::vec3 pos, glm::vec3 rot, glm::vec3 scale, bool occluder = false);
+void queueModel(Prop& prop, RenderQueue& queue);
+struct TerrainChunk;
+void queueTerrainChunk(const TerrainChunk& chunk, RenderQueue& queue);
+void recordDraws();
+void renderModels();
+void renderDepthPrepass();
+void createOcclusionQueries();
+void issueOcclusionQueries();
+void rasterizeOccluders();
+void buildTerrainOccluder(const unsigned char* data, int width, int height, int comp, float hScale, float xzScale);
 void renderQuad();
-unsigned int GeneratePlane(const char* heightmap, unsigned char*& data, GLenum format, int comp, float hScale, float xzScale, unsigned int& indexCount, unsigned int& heightmapID);
+unsigned int GeneratePlane(const char* heightmap, unsigned char*& data, GLenum format, int comp, float hScale, float xzScale, unsigned int& indexCount, unsigned int& heightmapID, unsigned int& depthVAO);
 
 // bloom functions
-void createBloomFramebuffers();
 void createBloomShaders();
-void renderBloom();
+RGHandle addBloomPasses(RGHandle source);
+void setBloomMode(bool mrt);
+void compareHDRFormats();
+
+// dynamic resolution
+void createFrameTimer();
+void beginFrameTimer();
+void endFrameTimer();
+void updateRenderScale();
+void resizeTargets();
 
 // window callbacks
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
-void processInput(GLFWwindow* window);
-
-bool keys[1024];
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+
+// simulation thread
+void startSimulation();
+void stopSimulation();
+struct CameraState;
+void simulationLoop(CameraState state);
+double updateCamera();
+void setCamera(const glm::vec3& position, float yaw, float pitch);
+double simClock();
+
+// frame pacing
+void beginFramePacing();
+void endFramePacing(double inputTime);
+
+// camera path recording and benchmark playback
+void toggleCameraRecording();
+void recordCameraPath();
+void playCameraPath(int frame);
+void recordBenchmarkFrame(int frame, double cpuSeconds);
+float percentile(const std::vector<float>& times, float p);
+void writeTimes(std::ostream& out, const char* name, std::vector<float> times);
+void writeFrameStats(std::ostream& out, const FrameStats& stats);
+void printFrameStats();
+void writeBenchmarkResults();
+
+// memory accounting
+void setMemoryBudgets();
+void releaseScene();
+
+// per-frame uniform buffer
+void createFrameData();
+void updateFrameData();
 
 void loadFile(const char* filename, char*& output);
 
-GLuint simpleProgram, skyProgram, terrainProgram, modelProgram, blitProgram, extractProgram, blurProgram, bloomProgram;
+// shader permutations
+std::string injectDefines(const char* source, const std::vector<std::string>& defines);
+std::map<std::string, GLuint> programPermutations;
+
+// program binary cache
+const char* PROGRAM_CACHE_DIR = "shadercache";
+int programCacheHits = 0;
+std::string programCachePath(const std::string& vertexSrc, const std::string& fragmentSrc);
+bool loadProgramBinary(GLuint& programID, const std::string& path);
+void saveProgramBinary(GLuint programID, const std::string& path);
+
+Shader simpleProgram, skyProgram, terrainProgram, modelProgram, extractProgram, downsampleProgram, upsampleProgram, bloomProgram;
+
+// compile-time specialized variants
+Shader terrainNoFogProgram, modelNoFogProgram;
+bool fogEnabled = true;
+
+// depth-only versions of the terrain and model vertex shaders. with the pre-pass on (F10) opaque geometry
+// is drawn to depth first, then shaded with GL_EQUAL so every pixel runs the expensive fragment shader once
+Shader terrainDepthProgram, modelDepthProgram;
+bool depthPrepass = true;
+
+// when set, scene shaders also write a thresholded copy to a second target (BRIGHT_OUTPUT),
+// otherwise bloom thresholds and downsamples the HDR color in a single pass
+bool bloomMRT = false;
+
+// luminance above which a pixel blooms, injected into whichever shaders apply it in the current mode
+#define BLOOM_THRESHOLD_DEFINE "BLOOM_THRESHOLD 0.3"
 
 // world data
 glm::vec3 lightDirection = glm::normalize(glm::vec3(-0.5f, -0.5f, -0.5f));
 glm::vec3 cameraPosition = glm::vec3(100.0f, 125.5f, 100.0f);
 
-GLuint boxVAO, boxEBO;
-int boxSize, boxIndexCount;
+// the sky triangle is generated in the vertex shader, core profile still wants a vertex array bound
+GLuint skyVAO;
 glm::mat4 view, projection;
 
+// std140 layout of the FrameData uniform block, vec3s are padded to 16 bytes
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 lightDirection;
+    glm::vec4 cameraPosition;
+};
+
+GLuint frameUBO;
+bool frameDataDirty = true;
+
 float lastX, lastY;
 bool firstMouse = true;
 float camYaw, camPitch;
 glm::quat camQuat = glm::quat(glm::vec3(glm::radians(camPitch), glm::radians(camYaw), 0));
 
 // terrain data
-GLuint terrainVAO, terrainIndexCount, heightmapID, heightNormalID;
+GLuint terrainVAO, terrainDepthVAO, terrainIndexCount, heightmapID, heightNormalID;
+GLuint terrainVBO, terrainEBO, terrainDepthVBO;
 unsigned char* heightmapTexture;
 
+// the terrain is drawn in square chunks of quads, each a contiguous range of its index buffer
+#define TERRAIN_CHUNK_SIZE 64
+struct TerrainChunk {
+    GLsizei count;
+    size_t first;
+    glm::vec3 boundsMin, boundsMax;
+};
+std::vector<TerrainChunk> terrainChunks;
+
 GLuint dirt, sand, grass, rock, snow;
 
 Model* backpack;
@@ -69,54 +195,311 @@ Model* rum;
 Model* watchtower;
 Model* apple;
 
-//bloom data
-unsigned int hdrFBO, colorBuffers[2];
-unsigned int rboDepth;
-unsigned int pingpongFBO[2];
-unsigned int pingpongColorbuffers[2];
-
-int main()
+// 1x1 stand-ins for the mesh texture units a material doesn't have: white diffuse, no specular, a flat normal,
+// full roughness and no occlusion
+GLuint defaultTextures[MESH_TEXTURE_UNITS];
+
+// a placed model. queries[] alternate every frame, the draw is conditional on the one issued last frame
+struct Prop {
+    Model* model;
+    glm::mat4 world;
+    glm::vec3 position;
+    GLuint queries[2];
+    bool issued[2];
+    bool occluder;
+};
+std::vector<Prop> props;
+
+// occlusion culling of the props against the terrain with their bounding boxes, F11 toggles it and G prints the stats.
+// pending counts props whose last query had no result yet, those are drawn
+struct OcclusionStats {
+    unsigned int tested, occluded, drawsSkipped;
+    unsigned int pending;
+};
+bool occlusionCulling = true;
+OcclusionStats occlusionStats;
+unsigned int occlusionFrame = 0;
+GLuint occlusionBoxVAO, occlusionBoxVBO, occlusionBoxEBO;
+
+// CPU occlusion culling, a coarse copy of the terrain and the props marked as occluder are rasterized on the
+// worker threads and props hidden behind them are not queued at all. F12 toggles it and G prints the stats
+bool softwareCulling = true;
+ThreadPool workerThreads;
+SoftwareOcclusion softwareOcclusion;
+std::vector<float> terrainOccluderVertices;
+std::vector<unsigned int> terrainOccluderIndices;
+
+// every state change goes through here, G prints how many calls reached the driver last frame
+GLState glState;
+GLState::Stats glStateFrame;
+
+// draws are recorded every frame by the worker threads, one queue per job, then merged into these,
+// sorted and submitted at once
+RenderQueue modelQueue, terrainQueue;
+std::vector<RenderQueue> modelJobQueues, terrainJobQueues;
+
+// world matrices of the occlusion query boxes
+RenderQueue occlusionBoxes;
+
+// per-frame dynamic data, the draw data of all queues is written here. RING_FRAMES frames can be in flight
+#define FRAME_RING_SIZE (1 << 20)
+RingBuffer frameRing;
+
+// render targets and passes of the frame, rebuilt every frame. textures come from its pool
+RenderGraph frameGraph;
+
+// GPU time of every graph pass and of the parts of the scene pass, averaged and logged every
+// GPU_TIMER_WINDOW frames. T turns the log line off and on
+GpuTimer gpuTimer;
+bool gpuTimerLog = true;
+
+// bloom mip chain, level 0 is half resolution and every next level is half the size of the previous one
+#define BLOOM_MAX_LEVELS 8
+
+// runtime bloom settings, levels are changed with F2/F3 and the upsample radius with F4/F5
+int bloomLevels = 6;
+float bloomRadius = 1.0f;
+float bloomIntensity = 0.3f;
+
+// format of the HDR scene and bloom targets, F7 switches to RGBA16F and back, F8 prints an A/B comparison
+GLenum hdrFormat = GL_R11F_G11F_B10F;
+bool compareFormatsRequested = false;
+
+// dynamic resolution, the scene is rendered into the bottom-left renderWidth x renderHeight part
+// of targets sized to the window and upscaled in the composite
+#define MIN_RENDER_SCALE 0.5f
+#define FRAME_QUERIES 4
+int windowWidth = WIDTH, windowHeight = HEIGHT;
+int targetWidth = WIDTH, targetHeight = HEIGHT;
+int renderWidth = WIDTH, renderHeight = HEIGHT;
+bool resizePending = false;
+
+// F9 toggles the controller, the scale stays at 1 while it is off
+bool dynamicResolution = true;
+float renderScale = 1.0f;
+float gpuBudgetMs = 16.6f;
+float gpuFrameMs = 0.0f;
+float upscaleSharpness = 0.3f;
+
+// the camera is simulated on its own thread at a fixed rate. the GLFW callbacks send it input through a
+// lock-free queue and the render thread reads back snapshots of the last two steps and blends between them,
+// so neither side ever waits for the other and movement speed no longer depends on the frame rate
+#define SIM_HZ 120
+#define CAMERA_SPEED 120.0f
+
+enum InputType {
+    INPUT_KEY,
+    INPUT_MOUSE
+};
+
+// time is when the callback received it, in simClock() seconds
+struct InputEvent {
+    InputType type;
+    int key;
+    bool down;
+    float dx, dy;
+    double time;
+};
+
+struct CameraState {
+    glm::vec3 position;
+    float yaw, pitch;
+};
+
+// time is when the current step was simulated, inputTime when the newest input event it includes was received,
+// both in simClock() seconds. inputTime is 0 until there was input
+struct CameraSnapshot {
+    CameraState previous, current;
+    double time;
+    double inputTime;
+};
+
+SPSCQueue<InputEvent, 1024> inputQueue;
+TripleBuffer<CameraSnapshot> cameraSnapshots;
+std::thread simThread;
+std::atomic<bool> simRunning(false);
+
+// every frame ends with a fence. in latency mode (L) the CPU waits for the fence of the frame framesInFlight
+// back before it reads the camera, so the driver can't queue up more frames than that. V switches vsync,
+// C cycles the frame rate cap. input-to-present latency is measured in every mode, from when the callback got the
+// newest input a frame shows up to the frame's fence, so the wait for the next simulation step is included.
+// lastInputTime is the newest input the render thread has shown
+#define FENCE_RING 8
+bool latencyMode = false;
+int framesInFlight = 2;
+int swapInterval = 1;
+float fpsCap = 0.0f;
+GLsync frameFences[FENCE_RING];
+double frameInputTimes[FENCE_RING];
+unsigned int pacedFrames = 0;
+double lastFrameStart = 0.0;
+float inputLatencyMs = 0.0f;
+double lastInputTime = 0.0;
+
+// timestamp pairs, read back FRAME_QUERIES - 1 frames later so the CPU never waits on them
+GLuint frameQueries[FRAME_QUERIES][2];
+unsigned int frameQueryIndex = 0, frameQueryCount = 0;
+
+// the last finished GPU frame time, unsmoothed. gpuFrameSamples counts the reads
+float gpuFrameSampleMs = 0.0f;
+unsigned int gpuFrameSamples = 0;
+
+// what was submitted in the frame being rendered and in the last finished one, the log splits it up by pass.
+// G prints the passes of the last frame
+FrameStats frameStats, lastFrameStats;
+FrameStatsLog frameStatsLog;
+
+// every texture, buffer and render target and the asset data kept on the CPU, M prints the totals and every asset.
+// a warning is printed when a category goes over its budget, and a benchmark that went over fails
+MemoryTracker memoryTracker;
+#define TEXTURE_BUDGET ((size_t)1024 << 20)
+#define VERTEX_BUFFER_BUDGET ((size_t)256 << 20)
+#define INDEX_BUFFER_BUDGET ((size_t)128 << 20)
+#define UNIFORM_BUFFER_BUDGET ((size_t)16 << 20)
+#define RENDER_TARGET_BUDGET ((size_t)256 << 20)
+#define CPU_ASSET_BUDGET ((size_t)256 << 20)
+
+// CPU profile of the loading and the first PROFILE_FRAMES frames is written to PROFILE_FILE as a Chrome trace,
+// P records another PROFILE_FRAMES frames to it
+#define PROFILE_FILE "trace.json"
+#define PROFILE_FRAMES 60
+int profileFramesLeft = PROFILE_FRAMES;
+
+// --headless N renders N frames into an offscreen framebuffer without a window or display, then exits
+HeadlessContext headlessContext;
+bool headless = false;
+int headlessFrames = 0;
+
+// R starts and stops recording the camera to CAMERA_PATH_FILE, a key every CAMERA_PATH_INTERVAL seconds.
+// --benchmark <path> [frames] plays a recorded path back over a fixed number of frames, the position of
+// every frame only depends on its number. the first BENCHMARK_WARMUP frames hold the start of the path
+// and are not measured. results go to benchmark.csv, benchmark_passes.csv and benchmark.json, then the program exits
+#define CAMERA_PATH_FILE "camera.path"
+#define CAMERA_PATH_INTERVAL 0.1
+#define BENCHMARK_WARMUP 30
+
+struct BenchmarkFrame {
+    float cpuMs, gpuMs;
+    FrameStats stats;
+    std::vector<FrameStatsLog::Section> passes;
+};
+
+CameraPath cameraPath;
+bool recordingPath = false;
+double pathRecordStart = 0.0, lastPathKey = 0.0;
+
+bool benchmarkMode = false;
+std::string benchmarkPath;
+int benchmarkFrames = 600;
+std::vector<BenchmarkFrame> benchmarkResults;
+unsigned int benchmarkGpuSamples = 0;
+
+int main(int argc, char** argv)
 {
-    // glfw init
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    Profiler::SetThreadName("main");
 
-    // make window
-    GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Hello Window :)", nullptr, nullptr);
-    if (window == nullptr) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            headless = true;
+            headlessFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmarkMode = true;
+            benchmarkPath = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                benchmarkFrames = std::max(atoi(argv[++i]), 1);
+        }
     }
 
-    // register callbacks
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetKeyCallback(window, key_callback);
+    if (benchmarkMode) {
+        if (!cameraPath.Load(benchmarkPath.c_str()))
+            return -3;
 
-    // context current
-    glfwMakeContextCurrent(window);
+        // a fixed resolution and no vsync, the benchmark decides when to stop
+        dynamicResolution = false;
+        swapInterval = 0;
+        headlessFrames = BENCHMARK_WARMUP + benchmarkFrames;
+    }
 
-    // load GLAD functions
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cout << "Error loading GLAD" << std::endl;
-        glfwTerminate();
-        return -2;
+    GLFWwindow* window = nullptr;
+    if (headless) {
+        if (!headlessContext.Create()) {
+            headlessContext.Release();
+            return -1;
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::ProcAddress)) {
+            std::cout << "Error loading GLAD" << std::endl;
+            headlessContext.Release();
+            return -2;
+        }
+        std::cout << "renderer " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+        headlessContext.CreateTargets(WIDTH, HEIGHT);
+        glState.Invalidate();
+    }
+    else {
+        // glfw init
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // make window
+        window = glfwCreateWindow(WIDTH, HEIGHT, "Hello Window :)", nullptr, nullptr);
+        if (window == nullptr) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+
+        // register callbacks
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+        // context current
+        glfwMakeContextCurrent(window);
+
+        // load GLAD functions
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Error loading GLAD" << std::endl;
+            glfwTerminate();
+            return -2;
+        }
+
+        glfwSwapInterval(swapInterval);
     }
 
-    glEnable(GL_DEPTH_TEST);
+    glState.Enable(GL_DEPTH_TEST);
 
-    createGeometry(boxVAO, boxEBO, boxSize, boxIndexCount);
+    glGenVertexArrays(1, &skyVAO);
+    double shaderStart = simClock();
     createShaders();
-    createBloomFramebuffers();
     createBloomShaders();
+    std::cout << "shaders ready in " << (simClock() - shaderStart) * 1000.0 << " ms, "
+        << programCacheHits << " loaded from the binary cache" << std::endl;
 
-    terrainVAO = GeneratePlane("textures/heightmap.png", heightmapTexture, GL_RGBA, 4, 100.0f, 5.0f, terrainIndexCount, heightmapID);
+    // the framebuffer can be larger than the window on high dpi screens
+    if (headless) {
+        windowWidth = WIDTH;
+        windowHeight = HEIGHT;
+    }
+    else {
+        glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+    }
+    targetWidth = renderWidth = windowWidth;
+    targetHeight = renderHeight = windowHeight;
+
+    setMemoryBudgets();
+    createFrameData();
+    createFrameTimer();
+
+    terrainVAO = GeneratePlane("textures/heightmap.png", heightmapTexture, GL_RGBA, 4, 100.0f, 5.0f, terrainIndexCount, heightmapID, terrainDepthVAO);
     heightNormalID = loadTexture("textures/heightnormal.png");
 
-    GLuint boxTex = loadTexture("textures/container2.png");
-    GLuint boxNormal = loadTexture("textures/container2_normal.png");
+    // the heightmap is on the GPU and in the terrain occluder now
+    stbi_image_free(heightmapTexture);
+    heightmapTexture = nullptr;
 
     dirt = loadTexture("textures/dirt.jpg");
     sand = loadTexture("textures/sand.jpg");
@@ -135,71 +518,269 @@ int main()
     watchtower = new Model("models/watchtower/watchtower.obj");
     apple = new Model("models/apple/apple.obj");
 
+    props.push_back(makeProp(backpack, glm::vec3(1334.5, 208, 1384.5), glm::vec3(0, 50, 0), glm::vec3(1.2, 1.2, 1.2)));
+    props.push_back(makeProp(rum, glm::vec3(1335, 210.35, 1382.2), glm::vec3(-90, 0, -35), glm::vec3(0.07, 0.1, 0.07)));
+    props.push_back(makeProp(watchtower, glm::vec3(1350, 140, 1400), glm::vec3(0, 180, 0), glm::vec3(10, 10, 10), true));
+    props.push_back(makeProp(apple, glm::vec3(1337, 210.35, 1382.2), glm::vec3(-90, 0, 0), glm::vec3(0.005, 0.005, 0.005)));
+    createOcclusionQueries();
+    softwareOcclusion.SetPool(&workerThreads);
+
+    // only the occluders are rasterized on the CPU, the other models don't need their vertices any more
+    for (unsigned int i = 0; i < props.size(); i++) {
+        bool occluder = false;
+        for (unsigned int j = 0; j < props.size(); j++)
+            occluder = occluder || (props[j].model == props[i].model && props[j].occluder);
+        if (!occluder)
+            props[i].model->ReleaseCpuData();
+    }
+
+    // one queue per recording job, every queue pads its draw data to the alignment of this GL
+    GLint drawDataAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &drawDataAlignment);
+    modelJobQueues.resize(workerThreads.Size());
+    terrainJobQueues.resize(workerThreads.Size());
+    for (unsigned int i = 0; i < workerThreads.Size(); i++) {
+        modelJobQueues[i].SetAlignment(drawDataAlignment);
+        terrainJobQueues[i].SetAlignment(drawDataAlignment);
+    }
+    modelQueue.SetAlignment(drawDataAlignment);
+    createDefaultTextures();
+    modelQueue.SetDefaultTextures(defaultTextures);
+    terrainQueue.SetAlignment(drawDataAlignment);
+    occlusionBoxes.SetAlignment(drawDataAlignment);
+    frameRing.Create(FRAME_RING_SIZE);
+    frameGraph.SetTimer(&gpuTimer);
+    frameGraph.SetStatsLog(&frameStatsLog);
+    std::cout << "loaded, " << memoryTracker.GpuTotal() / (1024 * 1024) << " MB on the GPU and "
+        << memoryTracker.Total(MEMORY_CPU_ASSETS) / (1024 * 1024) << " MB of assets on the CPU, M prints every asset" << std::endl;
+
     // creates OpenGL viewport
-    glViewport(0, 0, WIDTH, HEIGHT);
+    glState.Viewport(0, 0, windowWidth, windowHeight);
 
-    view = glm::lookAt(glm::vec3(cameraPosition), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-    projection = glm::perspective(glm::radians(45.0f), WIDTH / (float)HEIGHT, 0.1f, 5000.0f);
+    // starts out looking at the origin
+    glm::vec3 forward = glm::normalize(-cameraPosition);
+    camYaw = glm::degrees(std::atan2(forward.x, forward.z));
+    camPitch = glm::degrees(-std::asin(forward.y));
+    startSimulation();
+    updateCamera();
+    projection = glm::perspective(glm::radians(45.0f), windowWidth / (float)windowHeight, 0.1f, 5000.0f);
 
     // run loop
-    while (!glfwWindowShouldClose(window))
+    int frame = 0;
+    double runStart = simClock();
+    while (headless ? frame < headlessFrames : !glfwWindowShouldClose(window))
     {
-        glfwPollEvents();
-        processInput(window);
+        if (benchmarkMode && frame >= headlessFrames)
+            break;
 
-        float t = glfwGetTime();
-        float red = std::sinf(t);
+        if (profileFramesLeft > 0 && --profileFramesLeft == 0) {
+            Profiler::Write(PROFILE_FILE);
+            Profiler::Stop();
+        }
+        PROFILE_SCOPE("frame");
 
-        // render with framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glViewport(0, 0, WIDTH, HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // waits for the GPU in latency mode. the input polled here reaches the camera at the next simulation step
+        beginFramePacing();
+        double cpuStart = simClock();
+        if (!headless)
+            glfwPollEvents();
 
-        renderSkyBox();
-        renderTerrain();
+        double inputTime = 0.0;
+        if (benchmarkMode) {
+            playCameraPath(frame);
+        }
+        else {
+            inputTime = updateCamera();
+            recordCameraPath();
+        }
 
-        // models
-        renderModel(backpack, glm::vec3(1334.5, 208, 1384.5), glm::vec3(0, 50, 0), glm::vec3(1.2, 1.2, 1.2));
-        renderModel(rum, glm::vec3(1335, 210.35, 1382.2), glm::vec3(-90, 0, -35), glm::vec3(0.07, 0.1, 0.07));
-        renderModel(watchtower, glm::vec3(1350, 140, 1400), glm::vec3(0, 180, 0), glm::vec3(10, 10, 10));
-        renderModel(apple, glm::vec3(1337, 210.35, 1382.2), glm::vec3(-90, 0, 0), glm::vec3(0.005, 0.005, 0.005));
+        if (resizePending)
+            resizeTargets();
 
-        // applies bloom
-        renderBloom();
+        // minimized, sleeps until the window is restored instead of spinning without a swap to block on
+        if (windowWidth == 0 || windowHeight == 0) {
+            glfwWaitEvents();
+            continue;
+        }
+
+        updateFrameData();
 
-        // renders bloom to screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, WIDTH, HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDisable(GL_DEPTH_TEST);
+        float t = simClock();
+        float red = std::sin(t);
 
-        glUseProgram(bloomProgram);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glUniform1i(glGetUniformLocation(bloomProgram, "scene"), 0);
+        if (compareFormatsRequested) {
+            compareHDRFormats();
+            compareFormatsRequested = false;
+        }
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[0]);
-        glUniform1i(glGetUniformLocation(bloomProgram, "bloomBlur"), 1);
+        updateRenderScale();
 
-        renderQuad();
-        glEnable(GL_DEPTH_TEST);
+        beginFrameTimer();
+        renderFrame();
+        endFrameTimer();
+
+        glStateFrame = glState.stats;
+        glState.ResetStats();
+        lastFrameStats = frameStats;
+        frameStats = FrameStats();
+        frameStatsLog.EndFrame();
 
         // swap
-        glfwSwapBuffers(window);
+        if (!headless)
+            glfwSwapBuffers(window);
+        endFramePacing(inputTime);
+
+        if (benchmarkMode)
+            recordBenchmarkFrame(frame, simClock() - cpuStart);
+        frame++;
+    }
+
+    if (benchmarkMode)
+        writeBenchmarkResults();
+    bool overBudget = memoryTracker.OverBudget();
+    if (overBudget)
+        memoryTracker.Report(std::cout);
+
+    if (headless) {
+        glFinish();
+        double seconds = simClock() - runStart;
+        std::cout << "headless: " << frame << " frames in " << seconds << " s, "
+            << (frame ? seconds * 1000.0 / frame : 0.0) << " ms per frame" << std::endl;
     }
 
     // cleanup
-    delete backpack;
-    delete rum;
-    delete watchtower;
-    delete apple;
+    stopSimulation();
+    frameGraph.Release();
+    modelQueue.Release();
+    terrainQueue.Release();
+    occlusionBoxes.Release();
+    for (unsigned int i = 0; i < modelJobQueues.size(); i++)
+        modelJobQueues[i].Release();
+    for (unsigned int i = 0; i < terrainJobQueues.size(); i++)
+        terrainJobQueues[i].Release();
+    frameRing.Release();
+    gpuTimer.Release();
+    releaseScene();
 
     // terminate
-    glfwTerminate();
+    if (headless)
+        headlessContext.Release();
+    else
+        glfwTerminate();
+
+    // a benchmark that went over a memory budget fails
+    if (benchmarkMode && overBudget) {
+        std::cout << "ERROR: the benchmark went over a memory budget" << std::endl;
+        return -4;
+    }
     return 0;
 }
 
+// renders the scene into the HDR targets, applies bloom and composites to the default framebuffer
+void renderFrame()
+{
+    frameRing.BeginFrame();
+    gpuTimer.BeginFrame();
+    frameGraph.Reset();
+
+    RGHandle backbuffer = frameGraph.ImportBackbuffer(windowWidth, windowHeight, headlessContext.Framebuffer());
+    RGHandle sceneColor = frameGraph.CreateTexture("scene color", targetWidth, targetHeight, hdrFormat);
+    RGHandle sceneBright = bloomMRT ? frameGraph.CreateTexture("scene bright", targetWidth, targetHeight, hdrFormat) : RG_NONE;
+    RGHandle sceneDepth = frameGraph.CreateTexture("scene depth", targetWidth, targetHeight, GL_DEPTH_COMPONENT24);
+
+    // every pixel is covered by geometry or the sky, so only depth needs clearing
+    int scene = frameGraph.AddPass("scene", [](const RenderGraph& graph) {
+        glState.Viewport(0, 0, renderWidth, renderHeight);
+
+        rasterizeOccluders();
+        recordDraws();
+
+        if (depthPrepass) {
+            beginSection("depth prepass");
+            renderDepthPrepass();
+            endSection();
+
+            // depth is final, only the closest surface of each pixel passes
+            glState.DepthFunc(GL_EQUAL);
+            glState.DepthMask(GL_FALSE);
+        }
+
+        beginSection("terrain");
+        renderTerrain();
+        endSection();
+
+        // the prop boxes are tested against the terrain depth, either from the pre-pass or just drawn
+        if (!depthPrepass) {
+            beginSection("occlusion queries");
+            issueOcclusionQueries();
+            endSection();
+        }
+
+        beginSection("models");
+        renderModels();
+        endSection();
+
+        glState.DepthFunc(GL_LESS);
+        glState.DepthMask(GL_TRUE);
+
+        // last, so only the pixels left uncovered are shaded
+        beginSection("sky");
+        renderSkyBox();
+        endSection();
+    });
+    frameGraph.Write(scene, sceneColor, RG_DONT_CARE);
+    frameGraph.Write(scene, sceneBright, RG_DONT_CARE);
+    frameGraph.Write(scene, sceneDepth, RG_CLEAR);
+
+    // applies bloom
+    RGHandle bloom = addBloomPasses(bloomMRT ? sceneBright : sceneColor);
+
+    // renders bloom to screen, the quad covers the whole window
+    int composite = frameGraph.AddPass("composite", [sceneColor, bloom](const RenderGraph& graph) {
+        glState.Disable(GL_DEPTH_TEST);
+
+        bloomProgram.Use();
+        glState.BindTexture(0, graph.Texture(sceneColor));
+        bloomProgram.SetInt(UNIFORM("scene"), 0);
+
+        glState.BindTexture(1, graph.Texture(bloom));
+        bloomProgram.SetInt(UNIFORM("bloomBlur"), 1);
+        bloomProgram.SetFloat(UNIFORM("bloomStrength"), bloomIntensity / bloomLevels);
+
+        // upscales the rendered part of the scene texture, sharpening only when it is actually upscaled
+        glm::vec2 uvScale(renderWidth / (float)targetWidth, renderHeight / (float)targetHeight);
+        glUniform2fv(bloomProgram.Location(UNIFORM("uvScale")), 1, glm::value_ptr(uvScale));
+        CountUniform();
+        bloomProgram.SetFloat(UNIFORM("sharpness"), renderScale < 1.0f ? upscaleSharpness : 0.0f);
+
+        renderQuad();
+        glState.Enable(GL_DEPTH_TEST);
+    });
+    frameGraph.Read(composite, sceneColor);
+    frameGraph.Read(composite, bloom);
+    frameGraph.Write(composite, backbuffer, RG_DONT_CARE);
+
+    frameGraph.Compile();
+    frameGraph.Execute();
+    frameRing.EndFrame();
+
+    if (gpuTimer.EndFrame() && gpuTimerLog)
+        std::cout << "gpu ms per frame: " << gpuTimer.Summary() << std::endl;
+}
+
+// a part of a pass, timed on the GPU and counted in the frame stats
+void beginSection(const char* name)
+{
+    gpuTimer.Begin(name);
+    frameStatsLog.Begin(name);
+}
+
+void endSection()
+{
+    frameStatsLog.End();
+    gpuTimer.End();
+}
+
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
     float x = (float)xpos;
@@ -216,111 +797,208 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
     lastX = x;
     lastY = y;
 
-    camYaw -= dx;
-    camPitch = glm::clamp(camPitch + dy, -90.0f, 90.0f);
-    if (camYaw > 180.0f) camYaw -= 360.0f;
-    if (camYaw < -180.0f) camYaw += 360.0f;
-
-    camQuat = glm::quat(glm::vec3(glm::radians(camPitch), glm::radians(camYaw), 0));
-
-    glm::vec3 camForward = camQuat * glm::vec3(0, 0, 1);
-    glm::vec3 camUp = camQuat * glm::vec3(0, 1, 0);
-    view = glm::lookAt(cameraPosition, cameraPosition + camForward, camUp);
+    // applied by the simulation at its next step
+    InputEvent event;
+    event.type = INPUT_MOUSE;
+    event.key = 0;
+    event.down = false;
+    event.dx = dx;
+    event.dy = dy;
+    event.time = simClock();
+    inputQueue.Push(event);
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
-    if (action == GLFW_PRESS) {
-        keys[key] = true;
+    if (action == GLFW_PRESS || action == GLFW_RELEASE) {
+        InputEvent event;
+        event.type = INPUT_KEY;
+        event.key = key;
+        event.down = action == GLFW_PRESS;
+        event.dx = event.dy = 0.0f;
+        event.time = simClock();
+        inputQueue.Push(event);
     }
-    else if (action == GLFW_RELEASE) {
-        keys[key] = false;
-    }
-}
 
-void renderSkyBox() {
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
+    if (action == GLFW_PRESS) {
 
-    glUseProgram(skyProgram);
+        // toggles between the fog and fog-free shader permutations
+        if (key == GLFW_KEY_F1)
+            fogEnabled = !fogEnabled;
+
+        // bloom mip chain depth and spread
+        if (key == GLFW_KEY_F2 && bloomLevels > 1)
+            bloomLevels--;
+        if (key == GLFW_KEY_F3 && bloomLevels < BLOOM_MAX_LEVELS)
+            bloomLevels++;
+        if (key == GLFW_KEY_F4)
+            bloomRadius = glm::max(bloomRadius - 0.25f, 0.25f);
+        if (key == GLFW_KEY_F5)
+            bloomRadius = glm::min(bloomRadius + 0.25f, 4.0f);
+
+        // switches between the fused and the MRT bright pass
+        if (key == GLFW_KEY_F6)
+            setBloomMode(!bloomMRT);
+
+        // switches the HDR target format
+        if (key == GLFW_KEY_F7) {
+            hdrFormat = (hdrFormat == GL_RGBA16F) ? GL_R11F_G11F_B10F : GL_RGBA16F;
+            std::cout << "HDR format: " << (hdrFormat == GL_RGBA16F ? "RGBA16F" : "R11F_G11F_B10F") << std::endl;
+        }
+        if (key == GLFW_KEY_F8)
+            compareFormatsRequested = true;
 
-    // matrices
-    glm::mat4 world = glm::mat4(1.0f);
-    world = glm::translate(world, cameraPosition);
-    world = glm::scale(world, glm::vec3(10, 10, 10));
+        // depth pre-pass on/off, prints the GPU time measured with the previous setting
+        if (key == GLFW_KEY_F10) {
+            std::cout << "gpu frame " << gpuFrameMs << " ms with the depth pre-pass " << (depthPrepass ? "on" : "off") << std::endl;
+            depthPrepass = !depthPrepass;
+        }
+
+        // CPU occlusion culling on/off
+        if (key == GLFW_KEY_F12) {
+            softwareCulling = !softwareCulling;
+            std::cout << "software occlusion culling " << (softwareCulling ? "on" : "off") << std::endl;
+        }
 
-    glUniformMatrix4fv(glGetUniformLocation(skyProgram, "world"), 1, GL_FALSE, glm::value_ptr(world));
-    glUniformMatrix4fv(glGetUniformLocation(skyProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(skyProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        // occlusion culling on/off
+        if (key == GLFW_KEY_F11) {
+            occlusionCulling = !occlusionCulling;
+            std::cout << "occlusion culling " << (occlusionCulling ? "on" : "off") << std::endl;
+        }
 
-    glUniform3fv(glGetUniformLocation(skyProgram, "lightDirection"), 1, glm::value_ptr(lightDirection));
-    glUniform3fv(glGetUniformLocation(skyProgram, "cameraPosition"), 1, glm::value_ptr(cameraPosition));
+        if (key == GLFW_KEY_P && profileFramesLeft == 0) {
+            std::cout << "profiling " << PROFILE_FRAMES << " frames" << std::endl;
+            Profiler::Start();
+            profileFramesLeft = PROFILE_FRAMES;
+        }
 
-    // rendering
-    glBindVertexArray(boxVAO);
-    glDrawElements(GL_TRIANGLES, boxIndexCount, GL_UNSIGNED_INT, 0);
+        if (key == GLFW_KEY_T) {
+            gpuTimerLog = !gpuTimerLog;
+            std::cout << "gpu timer log " << (gpuTimerLog ? "on" : "off") << std::endl;
+        }
+
+        // camera path for --benchmark, starts recording or saves what was recorded
+        if (key == GLFW_KEY_R)
+            toggleCameraRecording();
+
+        // latency mode off -> 2 frames in flight -> 1 -> off, prints the latency measured with the previous setting
+        if (key == GLFW_KEY_L) {
+            std::cout << "input latency " << inputLatencyMs << " ms with "
+                << (latencyMode ? std::to_string(framesInFlight) + " frames in flight" : std::string("no frame limit")) << std::endl;
+            if (!latencyMode) {
+                latencyMode = true;
+                framesInFlight = 2;
+            }
+            else if (framesInFlight == 2) {
+                framesInFlight = 1;
+            }
+            else {
+                latencyMode = false;
+            }
+            inputLatencyMs = 0.0f;
+        }
+        if (key == GLFW_KEY_V) {
+            swapInterval = swapInterval ? 0 : 1;
+            glfwSwapInterval(swapInterval);
+            std::cout << "vsync " << (swapInterval ? "on" : "off") << std::endl;
+        }
+        if (key == GLFW_KEY_C) {
+            const float caps[] = { 0.0f, 30.0f, 60.0f, 120.0f, 144.0f };
+            unsigned int next = 0;
+            for (unsigned int i = 0; i < 5; i++) {
+                if (caps[i] == fpsCap)
+                    next = (i + 1) % 5;
+            }
+            fpsCap = caps[next];
+            std::cout << "frame rate cap " << (fpsCap > 0.0f ? std::to_string((int)fpsCap) : std::string("off")) << std::endl;
+        }
+
+        if (key == GLFW_KEY_G) {
+            printFrameStats();
+            std::cout << "occlusion: " << occlusionStats.tested << " props tested, " << occlusionStats.occluded << " occluded, "
+                << occlusionStats.drawsSkipped << " draws skipped, " << occlusionStats.pending << " results not ready last frame"
+                << std::endl;
+            std::cout << "software occlusion: " << softwareOcclusion.stats.triangles << " occluder triangles, " << softwareOcclusion.stats.tested
+                << " boxes tested, " << softwareOcclusion.stats.culled << " culled last frame" << std::endl;
+            std::cout << "gl state: " << glStateFrame.issued << " calls issued, " << glStateFrame.elided
+                << " elided last frame" << std::endl;
+            std::cout << "frame ring: " << frameRing.stats.used << " of " << frameRing.stats.capacity << " bytes in "
+                << frameRing.stats.allocations << " allocations, " << frameRing.stats.overflows << " overflows, "
+                << frameRing.stats.waits << " waits" << (frameRing.Persistent() ? "" : " (not persistent)") << std::endl;
+        }
+
+        if (key == GLFW_KEY_M)
+            memoryTracker.Report(std::cout);
 
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+        // dynamic resolution on/off
+        if (key == GLFW_KEY_F9) {
+            dynamicResolution = !dynamicResolution;
+            std::cout << "dynamic resolution " << (dynamicResolution ? "on" : "off") << std::endl;
+        }
+    }
 }
 
-void renderTerrain() {
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
+void renderSkyBox() {
+    // depth is cleared to 1.0 and the sky sits at exactly 1.0, LEQUAL passes only where nothing was drawn
+    glState.DepthFunc(GL_LEQUAL);
+    glState.DepthMask(GL_FALSE);
 
-    glUseProgram(terrainProgram);
+    skyProgram.Use();
 
-    glm::mat4 world = glm::mat4(1.0f);
+    // matrices
+    glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+    skyProgram.SetMat4(UNIFORM("inverseViewProjection"), inverseViewProjection);
+
+    // rendering
+    glState.BindVertexArray(skyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    CountDraw(3);
 
-    glUniformMatrix4fv(glGetUniformLocation(terrainProgram, "world"), 1, GL_FALSE, glm::value_ptr(world));
-    glUniformMatrix4fv(glGetUniformLocation(terrainProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(terrainProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glState.DepthMask(GL_TRUE);
+    glState.DepthFunc(GL_LESS);
+}
 
-    glUniform3fv(glGetUniformLocation(terrainProgram, "lightDirection"), 1, glm::value_ptr(lightDirection));
-    glUniform3fv(glGetUniformLocation(terrainProgram, "cameraPosition"), 1, glm::value_ptr(cameraPosition));
+void renderTerrain() {
+    glState.Enable(GL_DEPTH_TEST);
+    glState.Enable(GL_CULL_FACE);
+    glState.CullFace(GL_BACK);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, heightmapID);
+    glState.BindTexture(0, heightmapID);
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, heightNormalID);
+    glState.BindTexture(1, heightNormalID);
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, dirt);
+    glState.BindTexture(2, dirt);
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, sand);
+    glState.BindTexture(3, sand);
 
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, grass);
+    glState.BindTexture(4, grass);
 
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_2D, rock);
+    glState.BindTexture(5, rock);
 
-    glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_2D, snow);
+    glState.BindTexture(6, snow);
 
-    // rendering
-    glBindVertexArray(terrainVAO);
-    glDrawElements(GL_TRIANGLES, terrainIndexCount, GL_UNSIGNED_INT, 0);
+    // the chunks that survived culling, front to back
+    terrainQueue.Submit();
 }
 
-unsigned int GeneratePlane(const char* heightmap, unsigned char*& data, GLenum format, int comp, float hScale, float xzScale, unsigned int& indexCount, unsigned int& heightmapID) {
+unsigned int GeneratePlane(const char* heightmap, unsigned char*& data, GLenum format, int comp, float hScale, float xzScale, unsigned int& indexCount, unsigned int& heightmapID, unsigned int& depthVAO) {
+    PROFILE_SCOPE("GeneratePlane", heightmap);
+
     int width, height, channels;
     data = nullptr;
     if (heightmap != nullptr) {
         data = stbi_load(heightmap, &width, &height, &channels, comp);
         if (data) {
             glGenTextures(1, &heightmapID);
-            glBindTexture(GL_TEXTURE_2D, heightmapID);
+            glState.BindTexture(0, heightmapID);
 
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
             glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
             glGenerateMipmap(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            glState.BindTexture(0, 0);
+            memoryTracker.TrackTexture(heightmapID, MEMORY_TEXTURES, MemoryTracker::TextureBytes(width, height, format, true), heightmap);
         }
     }
 
@@ -347,36 +1025,65 @@ unsigned int GeneratePlane(const char* heightmap, unsigned char*& data, GLenum f
         vertices[index++] = z / (float)height;
     }
 
+    // quads are written chunk by chunk, so every chunk is one contiguous range of the index buffer
     index = 0;
-    for (int i = 0; i < (width - 1) * (height - 1); i++) {
-        int x = i % width;
-        int z = i / width;
-
-        int vertex = z * width + x;
-
-        indices[index++] = vertex;
-        indices[index++] = vertex + width;
-        indices[index++] = vertex + width + 1;
-
-        indices[index++] = vertex;
-        indices[index++] = vertex + width + 1;
-        indices[index++] = vertex + 1;
+    terrainChunks.clear();
+    for (int chunkZ = 0; chunkZ < height - 1; chunkZ += TERRAIN_CHUNK_SIZE) {
+        for (int chunkX = 0; chunkX < width - 1; chunkX += TERRAIN_CHUNK_SIZE) {
+            int endX = std::min(chunkX + TERRAIN_CHUNK_SIZE, width - 1);
+            int endZ = std::min(chunkZ + TERRAIN_CHUNK_SIZE, height - 1);
+
+            TerrainChunk chunk;
+            chunk.first = index * sizeof(unsigned int);
+
+            for (int z = chunkZ; z < endZ; z++) {
+                for (int x = chunkX; x < endX; x++) {
+                    int vertex = z * width + x;
+
+                    indices[index++] = vertex;
+                    indices[index++] = vertex + width;
+                    indices[index++] = vertex + width + 1;
+
+                    indices[index++] = vertex;
+                    indices[index++] = vertex + width + 1;
+                    indices[index++] = vertex + 1;
+                }
+            }
+
+            // the vertex shader adds the heightmap to the baked height once more, filtered between neighbouring
+            // texels and wrapped at the borders, so the range also covers a texel around the chunk on the other side
+            unsigned char lowest = 255, highest = 0;
+            for (int z = chunkZ - 1; z <= endZ + 1; z++) {
+                for (int x = chunkX - 1; x <= endX + 1; x++) {
+                    unsigned char texel = data[(((z + height) % height) * width + (x + width) % width) * comp];
+                    lowest = std::min(lowest, texel);
+                    highest = std::max(highest, texel);
+                }
+            }
+
+            chunk.count = (GLsizei)(index - chunk.first / sizeof(unsigned int));
+            chunk.boundsMin = glm::vec3(chunkX * xzScale, (lowest / 255.0f) * hScale * 2.0f, chunkZ * xzScale);
+            chunk.boundsMax = glm::vec3(endX * xzScale, (highest / 255.0f) * hScale * 2.0f, endZ * xzScale);
+            terrainChunks.push_back(chunk);
+        }
     }
 
     unsigned int vertSize = (width * height) * stride * sizeof(float);
     indexCount = ((width - 1) * (height - 1) * 6);
 
-    unsigned int VAO, VBO, EBO;
+    unsigned int VAO;
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    glGenBuffers(1, &terrainVBO);
+    glGenBuffers(1, &terrainEBO);
 
-    glBindVertexArray(VAO);
+    glState.BindVertexArray(VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
     glBufferData(GL_ARRAY_BUFFER, vertSize, vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+    memoryTracker.TrackBuffer(terrainVBO, MEMORY_VERTEX_BUFFERS, vertSize, "terrain");
+    memoryTracker.TrackBuffer(terrainEBO, MEMORY_INDEX_BUFFERS, indexCount * sizeof(unsigned int), "terrain");
 
     // position
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * stride, 0);
@@ -391,177 +1098,311 @@ unsigned int GeneratePlane(const char* heightmap, unsigned char*& data, GLenum f
     glEnableVertexAttribArray(2);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glState.BindVertexArray(0);
+
+    // depth pre-pass stream, position and the uv that samples the heightmap, sharing the index buffer
+    float* depthVertices = new float[(width * height) * 5];
+    for (int i = 0; i < (width * height); i++) {
+        memcpy(&depthVertices[i * 5], &vertices[i * stride], sizeof(float) * 3);
+        memcpy(&depthVertices[i * 5 + 3], &vertices[i * stride + 6], sizeof(float) * 2);
+    }
+
+    buildTerrainOccluder(data, width, height, comp, hScale, xzScale);
+
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &terrainDepthVBO);
+
+    glState.BindVertexArray(depthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, terrainDepthVBO);
+    glBufferData(GL_ARRAY_BUFFER, (width * height) * 5 * sizeof(float), depthVertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
+    memoryTracker.TrackBuffer(terrainDepthVBO, MEMORY_VERTEX_BUFFERS, (width * height) * 5 * sizeof(float), "terrain");
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 5, 0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 5, (void*)(sizeof(float) * 3));
+    glEnableVertexAttribArray(2);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glState.BindVertexArray(0);
 
     delete[] vertices;
+    delete[] depthVertices;
     delete[] indices;
 
     return VAO;
 }
 
-void processInput(GLFWwindow* window)
+// fixed steps of 1 / SIM_HZ seconds, each publishes the previous and the new camera state
+void simulationLoop(CameraState state)
 {
-    bool camChanged = false;
+    Profiler::SetThreadName("simulation");
+    const double step = 1.0 / SIM_HZ;
+    bool held[GLFW_KEY_LAST + 1] = { false };
+    double inputTime = 0.0;
+
+    double next = simClock();
+    while (simRunning) {
+        double now = simClock();
+        if (now < next) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(next - now));
+            continue;
+        }
 
-    if (keys[GLFW_KEY_W]) {
-        cameraPosition += camQuat * glm::vec3(0, 0, 2);
-        camChanged = true;
-    }
-    if (keys[GLFW_KEY_S]) {
-        cameraPosition += camQuat * glm::vec3(0, 0, -2);
-        camChanged = true;
-    }
-    if (keys[GLFW_KEY_A]) {
-        cameraPosition += camQuat * glm::vec3(2, 0, 0);
-        camChanged = true;
-    }
-    if (keys[GLFW_KEY_D]) {
-        cameraPosition += camQuat * glm::vec3(-2, 0, 0);
-        camChanged = true;
-    }
+        PROFILE_SCOPE("simulation step");
+        CameraState previous = state;
+
+        InputEvent event;
+        while (inputQueue.Pop(event)) {
+            inputTime = std::max(inputTime, event.time);
+            if (event.type == INPUT_KEY) {
+                if (event.key >= 0 && event.key <= GLFW_KEY_LAST)
+                    held[event.key] = event.down;
+            }
+            else {
+                state.yaw -= event.dx;
+                state.pitch = glm::clamp(state.pitch + event.dy, -90.0f, 90.0f);
+                if (state.yaw > 180.0f) state.yaw -= 360.0f;
+                if (state.yaw < -180.0f) state.yaw += 360.0f;
+            }
+        }
 
-    if (camChanged) {
-        glm::vec3 camForward = camQuat * glm::vec3(0, 0, 1);
-        glm::vec3 camUp = camQuat * glm::vec3(0, 1, 0);
-        view = glm::lookAt(cameraPosition, cameraPosition + camForward, camUp);
+        glm::vec3 move(0.0f);
+        if (held[GLFW_KEY_W]) move.z += 1.0f;
+        if (held[GLFW_KEY_S]) move.z -= 1.0f;
+        if (held[GLFW_KEY_A]) move.x += 1.0f;
+        if (held[GLFW_KEY_D]) move.x -= 1.0f;
+
+        glm::quat orientation = glm::quat(glm::vec3(glm::radians(state.pitch), glm::radians(state.yaw), 0));
+        state.position += orientation * move * (CAMERA_SPEED * (float)step);
+
+        CameraSnapshot& snapshot = cameraSnapshots.Back();
+        snapshot.previous = previous;
+        snapshot.current = state;
+        snapshot.time = next;
+        snapshot.inputTime = inputTime;
+        cameraSnapshots.Publish();
+
+        // after a long stall (debugger, window drag) carry on from now instead of running every missed step
+        next += step;
+        if (now - next > 0.25)
+            next = now;
     }
 }
 
-void createGeometry(GLuint& vao, GLuint& EBO, int& size, int& numIndices) {
-    // need 24 vertices for normal/uv-mapped Cube
-    float vertices[] = {
-        // positions            //colors            // tex coords   // normals          //tangents      //bitangents
-        0.5f, -0.5f, -0.5f,     1.0f, 1.0f, 1.0f,   1.f, 1.f,       0.f, -1.f, 0.f,     -1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
-        0.5f, -0.5f, 0.5f,      1.0f, 1.0f, 1.0f,   1.f, 0.f,       0.f, -1.f, 0.f,     -1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
-        -0.5f, -0.5f, 0.5f,     1.0f, 1.0f, 1.0f,   0.f, 0.f,       0.f, -1.f, 0.f,     -1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
-        -0.5f, -0.5f, -.5f,     1.0f, 1.0f, 1.0f,   0.f, 1.f,       0.f, -1.f, 0.f,     -1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
+void startSimulation()
+{
+    // the render thread sees the starting position until the first step is published
+    CameraSnapshot& snapshot = cameraSnapshots.Back();
+    snapshot.previous.position = snapshot.current.position = cameraPosition;
+    snapshot.previous.yaw = snapshot.current.yaw = camYaw;
+    snapshot.previous.pitch = snapshot.current.pitch = camPitch;
+    snapshot.time = simClock();
+    snapshot.inputTime = 0.0;
+    cameraSnapshots.Publish();
+
+    simRunning = true;
+    simThread = std::thread(simulationLoop, snapshot.current);
+}
 
-        0.5f, 0.5f, -0.5f,      1.0f, 1.0f, 1.0f,   1.f, 1.f,       1.f, 0.f, 0.f,     0.f, -1.f, 0.f,  0.f, 0.f, 1.f,
-        0.5f, 0.5f, 0.5f,       1.0f, 1.0f, 1.0f,   1.f, 0.f,       1.f, 0.f, 0.f,     0.f, -1.f, 0.f,  0.f, 0.f, 1.f,
+void stopSimulation()
+{
+    simRunning = false;
+    if (simThread.joinable())
+        simThread.join();
+}
 
-        0.5f, 0.5f, 0.5f,       1.0f, 1.0f, 1.0f,   1.f, 0.f,       0.f, 0.f, 1.f,     1.f, 0.f, 0.f,  0.f, -1.f, 0.f,
-        -0.5f, 0.5f, 0.5f,      1.0f, 1.0f, 1.0f,   0.f, 0.f,       0.f, 0.f, 1.f,     1.f, 0.f, 0.f,  0.f, -1.f, 0.f,
+// seconds on a monotonic clock shared by both threads, used instead of glfwGetTime() so it works without GLFW
+double simClock()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-        -0.5f, 0.5f, 0.5f,      1.0f, 1.0f, 1.0f,   0.f, 0.f,      -1.f, 0.f, 0.f,     0.f, 1.f, 0.f,  0.f, 0.f, 1.f,
-        -0.5f, 0.5f, -.5f,      1.0f, 1.0f, 1.0f,   0.f, 1.f,      -1.f, 0.f, 0.f,     0.f, 1.f, 0.f,  0.f, 0.f, 1.f,
+// blends the last two simulation steps by how far the current one is into its step, then rebuilds the view.
+// returns when the newest input was received if this is the first frame to show it, 0 otherwise
+double updateCamera()
+{
+    const CameraSnapshot& snapshot = cameraSnapshots.Read();
+    const CameraState& a = snapshot.previous;
+    const CameraState& b = snapshot.current;
 
-        -0.5f, 0.5f, -.5f,      1.0f, 1.0f, 1.0f,   0.f, 1.f,      0.f, 0.f, -1.f,     1.f, 0.f, 0.f,  0.f, 1.f, 0.f,
-        0.5f, 0.5f, -0.5f,      1.0f, 1.0f, 1.0f,   1.f, 1.f,      0.f, 0.f, -1.f,     1.f, 0.f, 0.f,  0.f, 1.f, 0.f,
+    float alpha = glm::clamp((float)((simClock() - snapshot.time) * SIM_HZ), 0.0f, 1.0f);
 
-        -0.5f, 0.5f, -.5f,      1.0f, 1.0f, 1.0f,   1.f, 1.f,       0.f, 1.f, 0.f,     1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
-        -0.5f, 0.5f, 0.5f,      1.0f, 1.0f, 1.0f,   1.f, 0.f,       0.f, 1.f, 0.f,     1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
+    // yaw wraps at +-180, turn the short way
+    float yawDelta = b.yaw - a.yaw;
+    if (yawDelta > 180.0f) yawDelta -= 360.0f;
+    if (yawDelta < -180.0f) yawDelta += 360.0f;
 
-        0.5f, -0.5f, 0.5f,      1.0f, 1.0f, 1.0f,   1.f, 1.f,       0.f, 0.f, 1.f,     1.f, 0.f, 0.f,  0.f, -1.f, 0.f,
-        -0.5f, -0.5f, 0.5f,     1.0f, 1.0f, 1.0f,   0.f, 1.f,       0.f, 0.f, 1.f,     1.f, 0.f, 0.f,  0.f, -1.f, 0.f,
+    glm::vec3 position = glm::mix(a.position, b.position, alpha);
+    float yaw = a.yaw + yawDelta * alpha;
+    float pitch = glm::mix(a.pitch, b.pitch, alpha);
 
-        -0.5f, -0.5f, 0.5f,     1.0f, 1.0f, 1.0f,   1.f, 0.f,       -1.f, 0.f, 0.f,     0.f, 1.f, 0.f,  0.f, 0.f, 1.f,
-        -0.5f, -0.5f, -.5f,     1.0f, 1.0f, 1.0f,   1.f, 1.f,       -1.f, 0.f, 0.f,     0.f, 1.f, 0.f,  0.f, 0.f, 1.f,
+    setCamera(position, yaw, pitch);
 
-        -0.5f, -0.5f, -.5f,     1.0f, 1.0f, 1.0f,   0.f, 0.f,       0.f, 0.f, -1.f,     1.f, 0.f, 0.f,  0.f, 1.f, 0.f,
-        0.5f, -0.5f, -0.5f,     1.0f, 1.0f, 1.0f,   1.f, 0.f,       0.f, 0.f, -1.f,     1.f, 0.f, 0.f,  0.f, 1.f, 0.f,
+    if (snapshot.inputTime <= lastInputTime)
+        return 0.0;
+    lastInputTime = snapshot.inputTime;
+    return snapshot.inputTime;
+}
 
-        0.5f, -0.5f, -0.5f,     1.0f, 1.0f, 1.0f,   0.f, 1.f,       1.f, 0.f, 0.f,     0.f, -1.f, 0.f,  0.f, 0.f, 1.f,
-        0.5f, -0.5f, 0.5f,      1.0f, 1.0f, 1.0f,   0.f, 0.f,       1.f, 0.f, 0.f,     0.f, -1.f, 0.f,  0.f, 0.f, 1.f,
+// rebuilds the view only when the camera moved
+void setCamera(const glm::vec3& position, float yaw, float pitch)
+{
+    if (position == cameraPosition && yaw == camYaw && pitch == camPitch)
+        return;
 
-        0.5f, 0.5f, -0.5f,      1.0f, 1.0f, 1.0f,   0.f, 1.f,       0.f, 1.f, 0.f,     1.f, 0.f, 0.f,  0.f, 0.f, 1.f,
-        0.5f, 0.5f, 0.5f,       1.0f, 1.0f, 1.0f,   0.f, 0.f,       0.f, 1.f, 0.f,     1.f, 0.f, 0.f,  0.f, 0.f, 1.f
-    };
+    cameraPosition = position;
+    camYaw = yaw;
+    camPitch = pitch;
+    camQuat = glm::quat(glm::vec3(glm::radians(camPitch), glm::radians(camYaw), 0));
 
-    unsigned int indices[] = {  // note that we start from 0!
-        // DOWN
-        0, 1, 2,   // first triangle
-        0, 2, 3,    // second triangle
-        // BACK
-        14, 6, 7,   // first triangle
-        14, 7, 15,    // second triangle
-        // RIGHT
-        20, 4, 5,   // first triangle
-        20, 5, 21,    // second triangle
-        // LEFT
-        16, 8, 9,   // first triangle
-        16, 9, 17,    // second triangle
-        // FRONT
-        18, 10, 11,   // first triangle
-        18, 11, 19,    // second triangle
-        // UP
-        22, 12, 13,   // first triangle
-        22, 13, 23,    // second triangle
-    };
+    glm::vec3 camForward = camQuat * glm::vec3(0, 0, 1);
+    glm::vec3 camUp = camQuat * glm::vec3(0, 1, 0);
+    view = glm::lookAt(cameraPosition, cameraPosition + camForward, camUp);
+    frameDataDirty = true;
+}
 
-    size = sizeof(vertices) / sizeof(float);
-    numIndices = sizeof(indices) / sizeof(int);
-    int stride = (3 + 3 + 2 + 3 + 3 + 3) * sizeof(float);
+// camera and light data, shared by every program through the FrameData uniform block
+void createFrameData()
+{
+    glGenBuffers(1, &frameUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    memoryTracker.TrackBuffer(frameUBO, MEMORY_UNIFORM_BUFFERS, sizeof(FrameData), "frame data");
+
+    // every program has its FrameData block attached to this binding point in Shader::Load
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameUBO);
+}
 
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+// uploads the camera and light data in one write, only when they changed since the last frame
+void updateFrameData()
+{
+    if (!frameDataDirty)
+        return;
 
-    GLuint VBO;
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    FrameData data;
+    data.view = view;
+    data.projection = projection;
+    data.lightDirection = glm::vec4(lightDirection, 0.0f);
+    data.cameraPosition = glm::vec4(cameraPosition, 1.0f);
 
-    glGenBuffers(1, &EBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    CountUpload(sizeof(FrameData));
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-    glEnableVertexAttribArray(0);
+    frameDataDirty = false;
+}
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+void createShaders() {
+    PROFILE_SCOPE("createShaders");
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
 
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_TRUE, stride, (void*)(8 * sizeof(float)));
-    glEnableVertexAttribArray(3);
+    simpleProgram.Load("shaders/simpleVertex.shader", "shaders/simpleFragment.shader");
 
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_TRUE, stride, (void*)(11 * sizeof(float)));
-    glEnableVertexAttribArray(4);
+    // set texture channels
+    simpleProgram.Use();
+    simpleProgram.SetInt(UNIFORM("mainTex"), 0);
+    simpleProgram.SetInt(UNIFORM("normalTex"), 1);
+    
 
-    glVertexAttribPointer(5, 3, GL_FLOAT, GL_TRUE, stride, (void*)(14 * sizeof(float)));
-    glEnableVertexAttribArray(5);
+    createSceneShaders();
 }
 
-void createShaders() {
-
-    createProgram(simpleProgram, "shaders/simpleVertex.shader", "shaders/simpleFragment.shader");
+// sky, terrain and model programs, these depend on the bloom mode
+void createSceneShaders() {
+    std::vector<std::string> defines;
+    if (bloomMRT) {
+        defines.push_back("BRIGHT_OUTPUT");
+        defines.push_back(BLOOM_THRESHOLD_DEFINE);
+    }
 
-    // set texture channels
-    glUseProgram(simpleProgram);
-    glUniform1i(glGetUniformLocation(simpleProgram, "mainTex"), 0);
-    glUniform1i(glGetUniformLocation(simpleProgram, "normalTex"), 1);
-    
+    std::vector<std::string> noFogDefines = defines;
+    noFogDefines.push_back("NO_FOG");
 
-    createProgram(skyProgram, "shaders/skyVertex.shader", "shaders/skyFragment.shader");
-    createProgram(terrainProgram, "shaders/terrainVertex.shader", "shaders/terrainFragment.shader");
-    createProgram(blitProgram, "shaders/imageVertex.shader", "shaders/imageFragment.shader");
+    skyProgram.Load("shaders/skyVertex.shader", "shaders/skyFragment.shader", defines);
 
-    glUseProgram(terrainProgram);
-    glUniform1i(glGetUniformLocation(terrainProgram, "mainTex"), 0); 
-    glUniform1i(glGetUniformLocation(terrainProgram, "normalTex"), 1);
+    terrainProgram.Load("shaders/terrainVertex.shader", "shaders/terrainFragment.shader", defines);
+    terrainNoFogProgram.Load("shaders/terrainVertex.shader", "shaders/terrainFragment.shader", noFogDefines);
 
-    glUniform1i(glGetUniformLocation(terrainProgram, "dirt"), 2);
-    glUniform1i(glGetUniformLocation(terrainProgram, "sand"), 3);
-    glUniform1i(glGetUniformLocation(terrainProgram, "grass"), 4);
-    glUniform1i(glGetUniformLocation(terrainProgram, "rock"), 5);
-    glUniform1i(glGetUniformLocation(terrainProgram, "snow"), 6);
+    Shader* terrainVariants[] = { &terrainProgram, &terrainNoFogProgram };
+    for (Shader* program : terrainVariants) {
+        program->Use();
+        program->SetInt(UNIFORM("mainTex"), 0);
+        program->SetInt(UNIFORM("normalTex"), 1);
 
-    createProgram(modelProgram, "shaders/model.vs", "shaders/model.fs");
-    glUseProgram(modelProgram);
+        program->SetInt(UNIFORM("dirt"), 2);
+        program->SetInt(UNIFORM("sand"), 3);
+        program->SetInt(UNIFORM("grass"), 4);
+        program->SetInt(UNIFORM("rock"), 5);
+        program->SetInt(UNIFORM("snow"), 6);
+    }
 
-    glUniform1i(glGetUniformLocation(modelProgram, "texture_diffuse1"), 0);
-    glUniform1i(glGetUniformLocation(modelProgram, "texture_specular1"), 1);
-    glUniform1i(glGetUniformLocation(modelProgram, "texture_normal1"), 2);
-    glUniform1i(glGetUniformLocation(modelProgram, "texture_roughness1"), 3);
-    glUniform1i(glGetUniformLocation(modelProgram, "texture_ao1"), 4);
+    terrainDepthProgram.Load("shaders/terrainVertex.shader", "shaders/depthFragment.shader", { "DEPTH_ONLY" });
+    terrainDepthProgram.Use();
+    terrainDepthProgram.SetInt(UNIFORM("mainTex"), 0);
+
+    modelProgram.Load("shaders/model.vs", "shaders/model.fs", defines);
+    modelNoFogProgram.Load("shaders/model.vs", "shaders/model.fs", noFogDefines);
+    modelDepthProgram.Load("shaders/model.vs", "shaders/depthFragment.shader", { "DEPTH_ONLY" });
+
+    Shader* modelVariants[] = { &modelProgram, &modelNoFogProgram };
+    for (Shader* program : modelVariants) {
+        program->Use();
+        program->SetInt(UNIFORM("texture_diffuse1"), 0);
+        program->SetInt(UNIFORM("texture_specular1"), 1);
+        program->SetInt(UNIFORM("texture_normal1"), 2);
+        program->SetInt(UNIFORM("texture_roughness1"), 3);
+        program->SetInt(UNIFORM("texture_ao1"), 4);
+    }
 }
 
-void createProgram(GLuint& programID, const char* vertex, const char* fragment) {
-    char* vertexSrc;
-    char* fragmentSrc;
-    loadFile(vertex, vertexSrc);
-    loadFile(fragment, fragmentSrc);
+void createProgram(GLuint& programID, const char* vertex, const char* fragment, const std::vector<std::string>& defines) {
+    PROFILE_SCOPE("createProgram", std::string(vertex) + " " + fragment);
+
+    // every permutation is compiled once, asking for the same files and defines again returns the same program
+    std::vector<std::string> sortedDefines = defines;
+    std::sort(sortedDefines.begin(), sortedDefines.end());
+
+    std::string permutationKey = std::string(vertex) + "|" + fragment;
+    for (unsigned int i = 0; i < sortedDefines.size(); i++)
+        permutationKey += "|" + sortedDefines[i];
+
+    std::map<std::string, GLuint>::iterator permutation = programPermutations.find(permutationKey);
+    if (permutation != programPermutations.end()) {
+        programID = permutation->second;
+        return;
+    }
+
+    char* vertexFile;
+    char* fragmentFile;
+    loadFile(vertex, vertexFile);
+    loadFile(fragment, fragmentFile);
+
+    if (vertexFile == NULL || fragmentFile == NULL) {
+        std::cout << "ERROR LOADING SHADER SOURCE\n" << vertex << ", " << fragment << std::endl;
+        delete[] vertexFile;
+        delete[] fragmentFile;
+        programID = 0;
+        return;
+    }
+
+    std::string vertexSource = injectDefines(vertexFile, sortedDefines);
+    std::string fragmentSource = injectDefines(fragmentFile, sortedDefines);
+    const char* vertexSrc = vertexSource.c_str();
+    const char* fragmentSrc = fragmentSource.c_str();
+
+    delete[] vertexFile;
+    delete[] fragmentFile;
+
+    // a previously linked binary skips compiling and linking entirely
+    std::string cachePath = programCachePath(vertexSource, fragmentSource);
+    if (loadProgramBinary(programID, cachePath)) {
+        programCacheHits++;
+        programPermutations[permutationKey] = programID;
+        return;
+    }
 
     GLuint vertexShaderID, fragmentShaderID;
 
@@ -590,19 +1431,142 @@ void createProgram(GLuint& programID, const char* vertex, const char* fragment)
     programID = glCreateProgram();
     glAttachShader(programID, vertexShaderID);
     glAttachShader(programID, fragmentShaderID);
+    glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(programID);
 
     glGetProgramiv(programID, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(fragmentShaderID, 512, nullptr, infoLog);
+        glGetProgramInfoLog(programID, 512, nullptr, infoLog);
         std::cout << "ERROR LINKING PROGRAM\n" << infoLog << std::endl;
     }
+    else {
+        saveProgramBinary(programID, cachePath);
+    }
 
     glDeleteShader(vertexShaderID);
     glDeleteShader(fragmentShaderID);
 
-    delete vertexSrc;
-    delete fragmentSrc;
+    programPermutations[permutationKey] = programID;
+}
+
+// inserts a #define line per entry ("NAME" or "NAME VALUE") right after the #version directive
+std::string injectDefines(const char* source, const std::vector<std::string>& defines) {
+    std::string src(source);
+    if (defines.empty())
+        return src;
+
+    size_t version = src.find("#version");
+    size_t insertAt = (version == std::string::npos) ? 0 : src.find('\n', version);
+    insertAt = (insertAt == std::string::npos) ? src.size() : insertAt + 1;
+
+    std::string block;
+    for (unsigned int i = 0; i < defines.size(); i++)
+        block += "#define " + defines[i] + "\n";
+
+    // keeps line numbers in compile errors pointing at the shader file
+    block += "#line 2\n";
+
+    src.insert(insertAt, block);
+    return src;
+}
+
+// 64 bit FNV-1a, continued from a previous hash
+uint64_t hashString(const char* str, uint64_t hash = 14695981039346656037ull) {
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// binaries are only valid for the driver that produced them, so the driver strings are part of the key
+std::string programCachePath(const std::string& vertexSrc, const std::string& fragmentSrc) {
+    uint64_t hash = hashString((const char*)glGetString(GL_VENDOR));
+    hash = hashString((const char*)glGetString(GL_RENDERER), hash);
+    hash = hashString((const char*)glGetString(GL_VERSION), hash);
+    hash = hashString(vertexSrc.c_str(), hash);
+    hash = hashString("|", hash);
+    hash = hashString(fragmentSrc.c_str(), hash);
+
+    std::stringstream path;
+    path << PROGRAM_CACHE_DIR << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return path.str();
+}
+
+bool programBinarySupported() {
+    if (!GLAD_GL_ARB_get_program_binary)
+        return false;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// returns false if there is no cached binary or the driver rejects it, programID is left at 0 in that case
+bool loadProgramBinary(GLuint& programID, const std::string& path) {
+    programID = 0;
+    if (!programBinarySupported())
+        return false;
+
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    file.seekg(0, file.end);
+    int length = (int)file.tellg() - (int)sizeof(GLenum);
+    file.seekg(0, file.beg);
+    if (length <= 0)
+        return false;
+
+    GLenum format;
+    std::vector<char> binary(length);
+    file.read((char*)&format, sizeof(GLenum));
+    file.read(binary.data(), length);
+    file.close();
+
+    programID = glCreateProgram();
+    glProgramBinary(programID, format, binary.data(), length);
+
+    int success;
+    glGetProgramiv(programID, GL_LINK_STATUS, &success);
+    if (!success) {
+        // driver update or format change, fall back to compiling from source
+        glState.DeleteProgram(programID);
+        programID = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void saveProgramBinary(GLuint programID, const std::string& path) {
+    if (!programBinarySupported())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    GLenum format;
+    std::vector<char> binary(length);
+    glGetProgramBinary(programID, length, nullptr, &format, binary.data());
+
+#ifdef _WIN32
+    _mkdir(PROGRAM_CACHE_DIR);
+#else
+    mkdir(PROGRAM_CACHE_DIR, 0755);
+#endif
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "Could not write program binary: " << path << std::endl;
+        return;
+    }
+
+    file.write((const char*)&format, sizeof(GLenum));
+    file.write(binary.data(), length);
+    file.close();
 }
 
 void loadFile(const char* filename, char*& output) {
@@ -629,11 +1593,34 @@ void loadFile(const char* filename, char*& output) {
     }
 }
 
+void createDefaultTextures()
+{
+    const unsigned char colors[MESH_TEXTURE_UNITS][4] = {
+        { 255, 255, 255, 255 },
+        { 0, 0, 0, 255 },
+        { 128, 128, 255, 255 },
+        { 255, 255, 255, 255 },
+        { 255, 255, 255, 255 }
+    };
+
+    glGenTextures(MESH_TEXTURE_UNITS, defaultTextures);
+    for (unsigned int unit = 0; unit < MESH_TEXTURE_UNITS; unit++) {
+        glState.BindTexture(0, defaultTextures[unit]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, colors[unit]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        memoryTracker.TrackTexture(defaultTextures[unit], MEMORY_TEXTURES, MemoryTracker::TextureBytes(1, 1, GL_RGBA, false), "default textures");
+    }
+    glState.BindTexture(0, 0);
+}
+
 GLuint loadTexture(const char* path, int comp)
 {
+    PROFILE_SCOPE("loadTexture", path);
+
     GLuint textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    glState.BindTexture(0, textureID);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -648,6 +1635,7 @@ GLuint loadTexture(const char* path, int comp)
         if (numChannels == 4)
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        memoryTracker.TrackTexture(textureID, MEMORY_TEXTURES, MemoryTracker::TextureBytes(width, height, numChannels == 3 ? GL_RGB : GL_RGBA, true), path);
     }
     else {
         std::cout << "Error loading texture: " << path << std::endl;
@@ -656,37 +1644,33 @@ GLuint loadTexture(const char* path, int comp)
     stbi_image_free(data);
 
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glState.BindTexture(0, 0);
 
     return textureID;
 }
 
-void renderModel(Model* model, glm::vec3 pos, glm::vec3 rot, glm::vec3 scale)
+// lays down the depth of the queued models and the terrain without any shading
+void renderDepthPrepass()
 {
-    //glEnable(GL_BLEND);
+    glState.Enable(GL_DEPTH_TEST);
+    glState.Enable(GL_CULL_FACE);
+    glState.CullFace(GL_BACK);
+    glState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-    //Alpha blend
-    //glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glState.BindTexture(0, heightmapID);
+    terrainQueue.SubmitDepth(terrainDepthProgram);
 
-    //Additive blend
-    //glBlendFunc(GL_ONE, GL_ONE);
+    // the prop boxes are tested against the terrain only
+    issueOcclusionQueries();
 
-    //Soft additive blend
-    //glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ONE);
-
-    //Multiply blend
-    //glBlendFunc(GL_DST_COLOR, GL_ZERO);
+    glState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    modelQueue.SubmitDepth(modelDepthProgram);
 
-    //Double multiply blend
-    //glBlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
-
-    glEnable(GL_DEPTH);
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-
-    glUseProgram(modelProgram);
+    glState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
 
+Prop makeProp(Model* model, glm::vec3 pos, glm::vec3 rot, glm::vec3 scale, bool occluder)
+{
     glm::mat4 world = glm::mat4(1.0f);
     world = glm::translate(world, pos);
     world = glm::scale(world, scale);
@@ -694,66 +1678,109 @@ void renderModel(Model* model, glm::vec3 pos, glm::vec3 rot, glm::vec3 scale)
     world = glm::rotate(world, glm::radians(rot.y), glm::vec3(0, 1, 0));
     world = glm::rotate(world, glm::radians(rot.z), glm::vec3(0, 0, 1));
 
-    glUniformMatrix4fv(glGetUniformLocation(modelProgram, "world"), 1, GL_FALSE, glm::value_ptr(world));
-    glUniformMatrix4fv(glGetUniformLocation(modelProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(modelProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    Prop prop;
+    prop.model = model;
+    prop.world = world;
+    prop.position = pos;
+    prop.queries[0] = prop.queries[1] = 0;
+    prop.issued[0] = prop.issued[1] = false;
+    prop.occluder = occluder;
+    return prop;
+}
+
+// runs on the worker threads, only reads shared state and writes to its own queue
+void queueModel(Prop& prop, RenderQueue& queue)
+{
+    // hidden behind the terrain or a large prop in the CPU depth buffer
+    if (softwareCulling && !softwareOcclusion.IsVisible(prop.model->boundsMin, prop.model->boundsMax, prop.world))
+        return;
 
+    // distance relative to the far plane, used to draw front to back within a material
+    float depth = glm::length(prop.position - cameraPosition) / 5000.0f;
 
-    glUniform3fv(glGetUniformLocation(modelProgram, "lightDirection"), 1, glm::value_ptr(lightDirection));
-    glUniform3fv(glGetUniformLocation(modelProgram, "cameraPosition"), 1, glm::value_ptr(cameraPosition));
+    Shader* program = fogEnabled ? &modelProgram : &modelNoFogProgram;
 
-    model->Draw(modelProgram);
+    // result of the query issued last frame
+    unsigned int previous = (occlusionFrame + 1) & 1;
+    GLuint condition = (occlusionCulling && prop.issued[previous]) ? prop.queries[previous] : 0;
 
-    // glDisable(GL_BLEND);
+    for (unsigned int i = 0; i < prop.model->meshes.size(); i++) {
+        Mesh* mesh = &prop.model->meshes[i];
+        uint64_t key = RenderQueue::MakeKey(PASS_OPAQUE, *program, mesh->materialID, depth);
+        queue.Push(key, program, mesh, prop.world, condition);
+    }
 }
 
-void createFrameBuffer(int width, int height, unsigned int& frameBufferID, unsigned int& colorBufferID, unsigned int& depthBufferID) {
-    
-    // generate frame buffer
-    glGenFramebuffers(1, &frameBufferID);
-
+// runs on the worker threads like queueModel
+void queueTerrainChunk(const TerrainChunk& chunk, RenderQueue& queue)
+{
+    if (softwareCulling && !softwareOcclusion.IsVisible(chunk.boundsMin, chunk.boundsMax, glm::mat4(1.0f)))
+        return;
 
-    // generate color buffer
-    glGenTextures(1, &colorBufferID);
-    glBindTexture(GL_TEXTURE_2D, colorBufferID);
+    float depth = glm::length((chunk.boundsMin + chunk.boundsMax) * 0.5f - cameraPosition) / 5000.0f;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    Shader* program = fogEnabled ? &terrainProgram : &terrainNoFogProgram;
+    uint64_t key = RenderQueue::MakeKey(PASS_OPAQUE, *program, 0, depth);
+    queue.Record(key, program, terrainVAO, terrainDepthVAO, chunk.count, chunk.first, nullptr, glm::mat4(1.0f));
+}
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+// culling, sort keys and draw data of the terrain chunks and props are recorded on the worker threads, each job
+// into its own queues. the GL thread then merges them, sorts and uploads the draw data once
+void recordDraws()
+{
+    PROFILE_SCOPE("recordDraws");
+    unsigned int jobs = (unsigned int)modelJobQueues.size();
+
+    workerThreads.ParallelFor(jobs, [jobs](unsigned int job) {
+        PROFILE_SCOPE("record draws job");
+        modelJobQueues[job].Clear();
+        terrainJobQueues[job].Clear();
+
+        for (size_t i = job; i < props.size(); i += jobs)
+            queueModel(props[i], modelJobQueues[job]);
+        for (size_t i = job; i < terrainChunks.size(); i += jobs)
+            queueTerrainChunk(terrainChunks[i], terrainJobQueues[job]);
+    });
+
+    modelQueue.Clear();
+    terrainQueue.Clear();
+    for (unsigned int i = 0; i < jobs; i++) {
+        modelQueue.Append(modelJobQueues[i]);
+        terrainQueue.Append(terrainJobQueues[i]);
+    }
 
-    // generate depth buffer
-    glGenRenderbuffers(1, &depthBufferID);
-    glBindRenderbuffer(GL_RENDERBUFFER, depthBufferID);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+    modelQueue.Sort();
+    terrainQueue.Sort();
+    modelQueue.Upload(&frameRing);
+    terrainQueue.Upload(&frameRing);
+}
 
-    // attach buffers
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBufferID);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,  colorBufferID, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBufferID);
+void renderModels()
+{
+    //glEnable(GL_BLEND);
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cout << "framebuffer not complete"<< std::endl;
-    }
+    //Alpha blend
+    //glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
+    //Additive blend
+    //glBlendFunc(GL_ONE, GL_ONE);
 
-void renderToBuffer(unsigned int frameBufferTo, unsigned int colorBufferFrom, unsigned int shader) {
-    glBindFramebuffer(GL_FRAMEBUFFER, frameBufferTo);
+    //Soft additive blend
+    //glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ONE);
 
-    glUseProgram(shader);
+    //Multiply blend
+    //glBlendFunc(GL_DST_COLOR, GL_ZERO);
 
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    //Double multiply blend
+    //glBlendFunc(GL_DST_COLOR, GL_SRC_COLOR);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorBufferFrom);
+    glState.Enable(GL_DEPTH_TEST);
+    glState.Enable(GL_CULL_FACE);
+    glState.CullFace(GL_BACK);
 
-    // rendering
-    renderQuad();
+    modelQueue.Submit();
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // glDisable(GL_BLEND);
 }
 
 unsigned int  quadVAO = 0;
@@ -776,122 +1803,738 @@ void renderQuad()
 
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        glState.BindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        memoryTracker.TrackBuffer(quadVBO, MEMORY_VERTEX_BUFFERS, sizeof(quadVertices), "fullscreen quad");
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    glState.BindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
+    CountDraw(6);
 }
 
-void createBloomFramebuffers()
+void createBloomShaders()
 {
-    // HDR framebuffer
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
+    // creates extract shader, it only thresholds when the scene shaders didn't already
+    extractProgram.Load("shaders/extractVertex.shader", "shaders/extractFragment.shader",
+        { bloomMRT ? "BRIGHT_INPUT" : BLOOM_THRESHOLD_DEFINE });
+    extractProgram.Use();
+    extractProgram.SetInt(UNIFORM("image"), 0);
+
+    // creates the mip chain shaders, every pass draws the same fullscreen quad as the extract pass
+    downsampleProgram.Load("shaders/extractVertex.shader", "shaders/downsampleFragment.shader");
+    downsampleProgram.Use();
+    downsampleProgram.SetInt(UNIFORM("image"), 0);
 
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++)
+    upsampleProgram.Load("shaders/extractVertex.shader", "shaders/upsampleFragment.shader");
+    upsampleProgram.Use();
+    upsampleProgram.SetInt(UNIFORM("image"), 0);
+
+    // creates combined bloom shader 
+    bloomProgram.Load("shaders/bloomVertex.shader", "shaders/bloomFragment.shader");
+    bloomProgram.Use();
+    bloomProgram.SetInt(UNIFORM("scene"), 0);
+    bloomProgram.SetInt(UNIFORM("bloomBlur"), 1);
+}
+
+// adds the bloom chain on top of the graph and returns the half resolution result
+RGHandle addBloomPasses(RGHandle source)
+{
+    RGHandle mips[BLOOM_MAX_LEVELS];
+    int mipWidth = targetWidth, mipHeight = targetHeight;
+    for (int i = 0; i < bloomLevels; i++)
     {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
-    }
-
-    // creates depth buffer
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, WIDTH, HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "HDR Framebuffer not complete!" << std::endl;
-
-    // pingpong buffers
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++)
+        mipWidth = glm::max(mipWidth / 2, 1);
+        mipHeight = glm::max(mipHeight / 2, 1);
+        mips[i] = frameGraph.CreateTexture("bloom mip", mipWidth, mipHeight, hdrFormat);
+    }
+
+    // thresholds and downsamples in one pass, straight into the half resolution top of the chain
+    int extract = frameGraph.AddPass("bloom extract", [source](const RenderGraph& graph) {
+        glState.Disable(GL_DEPTH_TEST);
+
+        extractProgram.Use();
+        glm::vec2 uvScale(renderWidth / (float)targetWidth, renderHeight / (float)targetHeight);
+        glUniform2fv(extractProgram.Location(UNIFORM("uvScale")), 1, glm::value_ptr(uvScale));
+        CountUniform();
+        glState.BindTexture(0, graph.Texture(source));
+        renderQuad();
+
+        glState.Enable(GL_DEPTH_TEST);
+    });
+    frameGraph.Read(extract, source);
+    frameGraph.Write(extract, mips[0], RG_DONT_CARE);
+
+    // downsamples every level from the one above it
+    for (int i = 1; i < bloomLevels; i++)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WIDTH, HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
+        RGHandle from = mips[i - 1];
+        int pass = frameGraph.AddPass("bloom downsample", [from](const RenderGraph& graph) {
+            glState.Disable(GL_DEPTH_TEST);
+
+            downsampleProgram.Use();
+            glState.BindTexture(0, graph.Texture(from));
+            renderQuad();
+
+            glState.Enable(GL_DEPTH_TEST);
+        });
+        frameGraph.Read(pass, from);
+        frameGraph.Write(pass, mips[i], RG_DONT_CARE);
+    }
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Ping-pong Framebuffer not complete!" << std::endl;
+    // walks back up the chain, adding each blurred level onto the next larger one
+    for (int i = bloomLevels - 1; i > 0; i--)
+    {
+        RGHandle from = mips[i];
+        int pass = frameGraph.AddPass("bloom upsample", [from](const RenderGraph& graph) {
+            glState.Disable(GL_DEPTH_TEST);
+            glState.Enable(GL_BLEND);
+            glState.BlendFunc(GL_ONE, GL_ONE);
+
+            upsampleProgram.Use();
+            upsampleProgram.SetFloat(UNIFORM("radius"), bloomRadius);
+            glState.BindTexture(0, graph.Texture(from));
+            renderQuad();
+
+            glState.Disable(GL_BLEND);
+            glState.Enable(GL_DEPTH_TEST);
+        });
+        frameGraph.Read(pass, from);
+        frameGraph.Write(pass, mips[i - 1], RG_LOAD);
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return mips[0];
 }
 
-void createBloomShaders()
+void setBloomMode(bool mrt)
 {
-    // creates extract shader
-    createProgram(extractProgram, "shaders/extractVertex.shader", "shaders/extractFragment.shader");
-    glUseProgram(extractProgram);
-    glUniform1i(glGetUniformLocation(extractProgram, "image"), 0);
+    bloomMRT = mrt;
 
-    // creates blur shader
-    createProgram(blurProgram, "shaders/blurVertex.shader", "shaders/blurFragment.shader");
-    glUseProgram(blurProgram);
-    glUniform1i(glGetUniformLocation(blurProgram, "image"), 0);
+    // the permutation cache makes switching back and forth free after the first time,
+    // the render graph picks up the extra target on the next frame
+    createSceneShaders();
+    createBloomShaders();
+}
 
-    // creates combined bloom shader 
-    createProgram(bloomProgram, "shaders/bloomVertex.shader", "shaders/bloomFragment.shader");
-    glUseProgram(bloomProgram);
-    glUniform1i(glGetUniformLocation(bloomProgram, "scene"), 0);
-    glUniform1i(glGetUniformLocation(bloomProgram, "bloomBlur"), 1);
+// renders the current view with RGBA16F and R11F_G11F_B10F targets, prints the frame time of both
+// and the error of the packed format against RGBA16F
+void compareHDRFormats()
+{
+    const int frames = 30;
+    GLenum formats[2] = { GL_RGBA16F, GL_R11F_G11F_B10F };
+    const char* names[2] = { "RGBA16F", "R11F_G11F_B10F" };
+    std::vector<float> pixels[2];
+    GLenum activeFormat = hdrFormat;
+
+    for (int f = 0; f < 2; f++)
+    {
+        hdrFormat = formats[f];
+
+        // first frame is a warm up for the new textures
+        renderFrame();
+        glFinish();
+
+        double start = simClock();
+        for (int i = 0; i < frames; i++)
+            renderFrame();
+        glFinish();
+        double ms = (simClock() - start) * 1000.0 / frames;
+
+        pixels[f].resize(windowWidth * windowHeight * 3);
+        glState.BindFramebuffer(0);
+        glReadPixels(0, 0, windowWidth, windowHeight, GL_RGB, GL_FLOAT, pixels[f].data());
+
+        std::ostringstream line;
+        line << names[f] << ": " << std::fixed << std::setprecision(3) << ms << " ms per frame";
+        std::cout << line.str() << std::endl;
+    }
+
+    // root mean square error of the final image, in 0-255 steps
+    double sum = 0.0;
+    for (size_t i = 0; i < pixels[0].size(); i++) {
+        double d = (pixels[1][i] - pixels[0][i]) * 255.0;
+        sum += d * d;
+    }
+    std::ostringstream line;
+    line << "RMSE of " << names[1] << " against " << names[0] << ": " << std::fixed << std::setprecision(3)
+        << std::sqrt(sum / pixels[0].size()) << " (0-255)";
+    std::cout << line.str() << std::endl;
+
+    hdrFormat = activeFormat;
 }
 
-void renderBloom()
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[0]);
-    glViewport(0, 0, WIDTH, HEIGHT);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glDisable(GL_DEPTH_TEST);
+    // handled at the start of the next frame, there can be several of these per frame while dragging
+    windowWidth = width;
+    windowHeight = height;
+    resizePending = true;
+}
 
-    glUseProgram(extractProgram);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[1]);
-    renderQuad();
+// resizes the render targets to the new window size and updates the projection
+void resizeTargets()
+{
+    resizePending = false;
+    if (windowWidth == 0 || windowHeight == 0)
+        return;
 
-    bool horizontal = true;
-    unsigned int amount = 10;
-    glUseProgram(blurProgram);
+    // the render graph allocates targets of the new size, the old ones age out of its pool
+    targetWidth = windowWidth;
+    targetHeight = windowHeight;
 
-    for (unsigned int i = 0; i < amount; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-        glUniform1i(glGetUniformLocation(blurProgram, "horizontal"), horizontal);
-        glActiveTexture(GL_TEXTURE0);
+    renderWidth = glm::max((int)(targetWidth * renderScale), 1);
+    renderHeight = glm::max((int)(targetHeight * renderScale), 1);
+
+    projection = glm::perspective(glm::radians(45.0f), windowWidth / (float)windowHeight, 0.1f, 5000.0f);
+    frameDataDirty = true;
+}
+
+void createFrameTimer()
+{
+    for (unsigned int i = 0; i < FRAME_QUERIES; i++)
+        glGenQueries(2, frameQueries[i]);
+}
+
+void beginFrameTimer()
+{
+    glQueryCounter(frameQueries[frameQueryIndex][0], GL_TIMESTAMP);
+}
+
+// reads the oldest pair of timestamps if the GPU is done with it
+void endFrameTimer()
+{
+    glQueryCounter(frameQueries[frameQueryIndex][1], GL_TIMESTAMP);
+    frameQueryIndex = (frameQueryIndex + 1) % FRAME_QUERIES;
+    if (frameQueryCount < FRAME_QUERIES) {
+        frameQueryCount++;
+        return;
+    }
+
+    GLuint available = 0;
+    glGetQueryObjectuiv(frameQueries[frameQueryIndex][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+        return;
+
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(frameQueries[frameQueryIndex][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(frameQueries[frameQueryIndex][1], GL_QUERY_RESULT, &end);
+
+    // smoothed, a single slow frame shouldn't change the resolution
+    float ms = (end - start) / 1000000.0f;
+    gpuFrameSampleMs = ms;
+    gpuFrameSamples++;
+    gpuFrameMs = (gpuFrameMs == 0.0f) ? ms : glm::mix(gpuFrameMs, ms, 0.1f);
+}
+
+// moves the render scale towards the resolution that fits the GPU budget
+void updateRenderScale()
+{
+    float scale = renderScale;
+
+    if (!dynamicResolution) {
+        scale = 1.0f;
+    }
+    else if (gpuFrameMs > 0.0f) {
+        // cost is roughly proportional to the pixel count, so the scale follows the square root.
+        // scales down quickly when over budget, up slowly with some headroom to avoid oscillating
+        float target = renderScale * std::sqrt(gpuBudgetMs / gpuFrameMs);
+        if (gpuFrameMs > gpuBudgetMs)
+            scale = glm::max(target, renderScale - 0.05f);
+        else if (gpuFrameMs < gpuBudgetMs * 0.85f)
+            scale = glm::min(target, renderScale + 0.01f);
+
+        scale = glm::clamp(scale, MIN_RENDER_SCALE, 1.0f);
+    }
+
+    if (scale == renderScale)
+        return;
+
+    renderScale = scale;
+    renderWidth = glm::max((int)(targetWidth * renderScale), 1);
+    renderHeight = glm::max((int)(targetHeight * renderScale), 1);
+}
+
+// unit cube used to draw the prop bounding boxes into the queries
+void createOcclusionQueries()
+{
+    float vertices[] = {
+        0, 0, 0,  1, 0, 0,  1, 1, 0,  0, 1, 0,
+        0, 0, 1,  1, 0, 1,  1, 1, 1,  0, 1, 1
+    };
+    unsigned int indices[] = {
+        0, 2, 1,  0, 3, 2,
+        4, 5, 6,  4, 6, 7,
+        0, 1, 5,  0, 5, 4,
+        3, 6, 2,  3, 7, 6,
+        0, 4, 7,  0, 7, 3,
+        1, 2, 6,  1, 6, 5
+    };
+
+    glGenVertexArrays(1, &occlusionBoxVAO);
+    glGenBuffers(1, &occlusionBoxVBO);
+    glGenBuffers(1, &occlusionBoxEBO);
+
+    glState.BindVertexArray(occlusionBoxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, occlusionBoxVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, occlusionBoxEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    memoryTracker.TrackBuffer(occlusionBoxVBO, MEMORY_VERTEX_BUFFERS, sizeof(vertices), "occlusion box");
+    memoryTracker.TrackBuffer(occlusionBoxEBO, MEMORY_INDEX_BUFFERS, sizeof(indices), "occlusion box");
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 3, 0);
+    glEnableVertexAttribArray(0);
+    glState.BindVertexArray(0);
 
-        // first uses the normal result, then goes for pingpong
-        if (i == 0) {
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[0]);
+    for (unsigned int i = 0; i < props.size(); i++)
+        glGenQueries(2, props[i].queries);
+}
+
+// reads last frame's results for the stats, then draws every prop box into this frame's query.
+// expects the terrain depth to be in place, writes no color or depth
+void issueOcclusionQueries()
+{
+    unsigned int current = occlusionFrame & 1;
+    unsigned int previous = current ^ 1;
+    occlusionFrame++;
+
+    occlusionStats = OcclusionStats();
+
+    // the boxes are recorded first so their matrices go up in one upload
+    occlusionBoxes.Clear();
+    std::vector<unsigned int> tested;
+
+    for (unsigned int i = 0; i < props.size(); i++) {
+        Prop& prop = props[i];
+        prop.issued[current] = false;
+
+        if (!occlusionCulling)
+            continue;
+
+        // the draws use GL_QUERY_NO_WAIT, a result that isn't there yet doesn't skip anything and is counted apart
+        if (prop.issued[previous]) {
+            GLuint available = 0, visible = 1;
+            glGetQueryObjectuiv(prop.queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                occlusionStats.pending++;
+            }
+            else {
+                glGetQueryObjectuiv(prop.queries[previous], GL_QUERY_RESULT, &visible);
+                occlusionStats.tested++;
+                if (!visible) {
+                    occlusionStats.occluded++;
+                    occlusionStats.drawsSkipped += (unsigned int)prop.model->meshes.size();
+                }
+            }
         }
-        else {
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+
+        // the box would be clipped by the near plane, the prop is always drawn while the camera is inside
+        glm::vec3 local = glm::vec3(glm::inverse(prop.world) * glm::vec4(cameraPosition, 1.0f));
+        glm::vec3 margin = (prop.model->boundsMax - prop.model->boundsMin) * 0.05f;
+        if (glm::all(glm::greaterThan(local, prop.model->boundsMin - margin)) && glm::all(glm::lessThan(local, prop.model->boundsMax + margin)))
+            continue;
+
+        glm::mat4 box = prop.world * glm::translate(glm::mat4(1.0f), prop.model->boundsMin) *
+            glm::scale(glm::mat4(1.0f), prop.model->boundsMax - prop.model->boundsMin);
+
+        occlusionBoxes.Record(0, &modelDepthProgram, occlusionBoxVAO, occlusionBoxVAO, 36, 0, nullptr, box);
+        tested.push_back(i);
+    }
+
+    if (tested.empty())
+        return;
+
+    occlusionBoxes.Upload(&frameRing);
+
+    glState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glState.DepthMask(GL_FALSE);
+    glState.Disable(GL_CULL_FACE);
+
+    modelDepthProgram.Use();
+    glState.BindVertexArray(occlusionBoxVAO);
+
+    for (unsigned int i = 0; i < tested.size(); i++) {
+        Prop& prop = props[tested[i]];
+        occlusionBoxes.BindDrawData(i);
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, prop.queries[current]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        CountDraw(36);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        prop.issued[current] = true;
+    }
+
+    glState.Enable(GL_CULL_FACE);
+    glState.DepthMask(GL_TRUE);
+    glState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+// coarse copy of the terrain for the CPU occlusion buffer, a vertex every 16 texels. every vertex takes the
+// lowest height around it so the coarse surface stays below the real one and never hides too much.
+// the terrain vertex shader adds the heightmap on top of the baked height, hence 2 * hScale
+void buildTerrainOccluder(const unsigned char* data, int width, int height, int comp, float hScale, float xzScale)
+{
+    const int step = 16;
+    int columns = (width + step - 2) / step + 1;
+    int rows = (height + step - 2) / step + 1;
+
+    terrainOccluderVertices.clear();
+    terrainOccluderIndices.clear();
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            int x = std::min(c * step, width - 1);
+            int z = std::min(r * step, height - 1);
+
+            unsigned char lowest = 255;
+            for (int tz = std::max(z - step, 0); tz <= std::min(z + step, height - 1); tz++) {
+                for (int tx = std::max(x - step, 0); tx <= std::min(x + step, width - 1); tx++)
+                    lowest = std::min(lowest, data[(tz * width + tx) * comp]);
+            }
+
+            terrainOccluderVertices.push_back(x * xzScale);
+            terrainOccluderVertices.push_back((lowest / 255.0f) * hScale * 2.0f);
+            terrainOccluderVertices.push_back(z * xzScale);
         }
+    }
 
-        renderQuad();
-        horizontal = !horizontal;
+    for (int r = 0; r < rows - 1; r++) {
+        for (int c = 0; c < columns - 1; c++) {
+            unsigned int vertex = r * columns + c;
+
+            terrainOccluderIndices.push_back(vertex);
+            terrainOccluderIndices.push_back(vertex + columns);
+            terrainOccluderIndices.push_back(vertex + columns + 1);
+
+            terrainOccluderIndices.push_back(vertex);
+            terrainOccluderIndices.push_back(vertex + columns + 1);
+            terrainOccluderIndices.push_back(vertex + 1);
+        }
     }
 
-    glEnable(GL_DEPTH_TEST);
-}
\ No newline at end of file
+    memoryTracker.TrackCpu(&terrainOccluderVertices, terrainOccluderVertices.capacity() * sizeof(float) +
+        terrainOccluderIndices.capacity() * sizeof(unsigned int), "terrain occluder");
+}
+
+// fills the CPU depth buffer for this frame's camera, queueModel tests against it
+void rasterizeOccluders()
+{
+    PROFILE_SCOPE("rasterizeOccluders");
+    softwareOcclusion.Clear();
+    if (!softwareCulling)
+        return;
+
+    softwareOcclusion.SetViewProjection(projection * view);
+
+    if (!terrainOccluderIndices.empty()) {
+        softwareOcclusion.AddOccluder(&terrainOccluderVertices[0], sizeof(float) * 3, terrainOccluderVertices.size() / 3,
+            &terrainOccluderIndices[0], terrainOccluderIndices.size(), glm::mat4(1.0f));
+    }
+
+    for (unsigned int i = 0; i < props.size(); i++) {
+        if (!props[i].occluder)
+            continue;
+
+        for (unsigned int j = 0; j < props[i].model->meshes.size(); j++) {
+            Mesh& mesh = props[i].model->meshes[j];
+            if (mesh.indices.empty())
+                continue;
+
+            softwareOcclusion.AddOccluder(&mesh.vertices[0].Position.x, sizeof(Vertex), mesh.vertices.size(),
+                &mesh.indices[0], mesh.indices.size(), props[i].world);
+        }
+    }
+
+    softwareOcclusion.Rasterize();
+}
+
+// collects the fences of finished frames, waiting for the one framesInFlight frames back in latency mode,
+// then holds the frame back if it would start before the frame rate cap allows
+void beginFramePacing()
+{
+    for (unsigned int age = FENCE_RING - 1; age >= 1; age--) {
+        if (age > pacedFrames)
+            continue;
+
+        unsigned int slot = (pacedFrames - age) % FENCE_RING;
+        if (!frameFences[slot])
+            continue;
+
+        bool wait = latencyMode && age >= (unsigned int)framesInFlight;
+        GLenum result = glClientWaitSync(frameFences[slot], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+            continue;
+
+        // the GPU finished the frame, close enough to when it was presented. frames without new input aren't measured
+        if (frameInputTimes[slot] > 0.0) {
+            float ms = (float)((simClock() - frameInputTimes[slot]) * 1000.0);
+            inputLatencyMs = (inputLatencyMs == 0.0f) ? ms : glm::mix(inputLatencyMs, ms, 0.1f);
+        }
+
+        glDeleteSync(frameFences[slot]);
+        frameFences[slot] = 0;
+    }
+
+    if (fpsCap > 0.0f) {
+        double start = lastFrameStart + 1.0 / fpsCap;
+
+        // sleep most of the way, the OS wakes us up late, then spin the rest
+        double remaining = start - simClock();
+        if (remaining > 0.002)
+            std::this_thread::sleep_for(std::chrono::duration<double>(remaining - 0.002));
+        while (simClock() < start)
+            std::this_thread::yield();
+    }
+    lastFrameStart = simClock();
+}
+
+// fences the frame just swapped, remembering when the newest input it shows was received (0 for none)
+void endFramePacing(double inputTime)
+{
+    unsigned int slot = pacedFrames % FENCE_RING;
+
+    // so old it was never collected, it can't be measured anymore
+    if (frameFences[slot])
+        glDeleteSync(frameFences[slot]);
+
+    frameFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frameInputTimes[slot] = inputTime;
+    pacedFrames++;
+}
+
+// R: the first press starts a new path, the second one saves it
+void toggleCameraRecording()
+{
+    if (!recordingPath) {
+        cameraPath.Clear();
+        pathRecordStart = simClock();
+        lastPathKey = pathRecordStart - CAMERA_PATH_INTERVAL;
+        recordingPath = true;
+        std::cout << "recording camera path, R to stop" << std::endl;
+        return;
+    }
+
+    recordingPath = false;
+    cameraPath.Add((float)(simClock() - pathRecordStart), cameraPosition, camYaw, camPitch);
+    if (cameraPath.Save(CAMERA_PATH_FILE)) {
+        std::cout << "saved " << cameraPath.Size() << " camera keys, " << cameraPath.Duration() << " s, to "
+            << CAMERA_PATH_FILE << std::endl;
+    }
+}
+
+void recordCameraPath()
+{
+    if (!recordingPath)
+        return;
+
+    double now = simClock();
+    if (now - lastPathKey < CAMERA_PATH_INTERVAL)
+        return;
+
+    cameraPath.Add((float)(now - pathRecordStart), cameraPosition, camYaw, camPitch);
+    lastPathKey = now;
+}
+
+// spreads the path evenly over the measured frames, so every run sees the same camera on the same frame
+void playCameraPath(int frame)
+{
+    int measured = std::max(frame - BENCHMARK_WARMUP, 0);
+    float t = cameraPath.Duration() * measured / (float)std::max(benchmarkFrames - 1, 1);
+
+    glm::vec3 position;
+    float yaw, pitch;
+    cameraPath.Sample(t, position, yaw, pitch);
+
+    yaw = std::fmod(yaw + 180.0f, 360.0f);
+    if (yaw < 0.0f) yaw += 360.0f;
+    setCamera(position, yaw - 180.0f, pitch);
+}
+
+void recordBenchmarkFrame(int frame, double cpuSeconds)
+{
+    if (frame < BENCHMARK_WARMUP)
+        return;
+
+    BenchmarkFrame result;
+    result.cpuMs = (float)(cpuSeconds * 1000.0);
+    result.gpuMs = -1.0f;
+    result.stats = lastFrameStats;
+    result.passes = frameStatsLog.Last();
+    benchmarkResults.push_back(result);
+
+    // the GPU time read this frame belongs to the frame FRAME_QUERIES - 1 back, frames whose
+    // timestamps weren't ready in time have none
+    if (gpuFrameSamples != benchmarkGpuSamples) {
+        benchmarkGpuSamples = gpuFrameSamples;
+        int index = (int)benchmarkResults.size() - FRAME_QUERIES;
+        if (index >= 0)
+            benchmarkResults[index].gpuMs = gpuFrameSampleMs;
+    }
+}
+
+// nearest rank, times has to be sorted
+float percentile(const std::vector<float>& times, float p)
+{
+    if (times.empty())
+        return 0.0f;
+
+    size_t rank = (size_t)std::ceil(p * times.size());
+    return times[std::min(std::max(rank, (size_t)1), times.size()) - 1];
+}
+
+void writeTimes(std::ostream& out, const char* name, std::vector<float> times)
+{
+    std::sort(times.begin(), times.end());
+
+    double sum = 0.0;
+    for (size_t i = 0; i < times.size(); i++)
+        sum += times[i];
+
+    out << "  \"" << name << "\": { \"samples\": " << times.size()
+        << ", \"mean\": " << (times.empty() ? 0.0 : sum / times.size())
+        << ", \"p50\": " << percentile(times, 0.50f)
+        << ", \"p95\": " << percentile(times, 0.95f)
+        << ", \"p99\": " << percentile(times, 0.99f)
+        << ", \"max\": " << (times.empty() ? 0.0f : times.back()) << " }";
+}
+
+// the FrameStats columns of the benchmark CSVs
+#define FRAME_STATS_COLUMNS "draws,indices,triangles,program_switches,texture_binds,uniform_uploads,buffer_bytes"
+
+void writeFrameStats(std::ostream& out, const FrameStats& stats)
+{
+    out << stats.draws << "," << stats.indices << "," << stats.triangles << "," << stats.programSwitches << ","
+        << stats.textureBinds << "," << stats.uniformUploads << "," << stats.bufferBytes;
+}
+
+// every measured frame to benchmark.csv and every pass of it to benchmark_passes.csv,
+// percentiles and averages to benchmark.json
+void writeBenchmarkResults()
+{
+    std::vector<float> cpu, gpu;
+    double draws = 0.0, triangles = 0.0;
+
+    std::ofstream csv("benchmark.csv");
+    std::ofstream passCsv("benchmark_passes.csv");
+    csv << "frame,cpu_ms,gpu_ms," FRAME_STATS_COLUMNS "\n";
+    passCsv << "frame,pass," FRAME_STATS_COLUMNS "\n";
+    for (size_t i = 0; i < benchmarkResults.size(); i++) {
+        const BenchmarkFrame& r = benchmarkResults[i];
+        csv << i << "," << r.cpuMs << ",";
+        if (r.gpuMs >= 0.0f) {
+            csv << r.gpuMs;
+            gpu.push_back(r.gpuMs);
+        }
+        csv << ",";
+        writeFrameStats(csv, r.stats);
+        csv << "\n";
+
+        for (size_t p = 0; p < r.passes.size(); p++) {
+            passCsv << i << "," << r.passes[p].name << ",";
+            writeFrameStats(passCsv, r.passes[p].stats);
+            passCsv << "\n";
+        }
+
+        cpu.push_back(r.cpuMs);
+        draws += r.stats.draws;
+        triangles += r.stats.triangles;
+    }
+
+    size_t frames = std::max(benchmarkResults.size(), (size_t)1);
+    std::string path = benchmarkPath;
+    std::replace(path.begin(), path.end(), '\\', '/');
+
+    std::ofstream json("benchmark.json");
+    json << "{\n";
+    json << "  \"path\": \"" << path << "\",\n";
+    json << "  \"frames\": " << benchmarkResults.size() << ",\n";
+    json << "  \"width\": " << renderWidth << ",\n";
+    json << "  \"height\": " << renderHeight << ",\n";
+    writeTimes(json, "cpu_ms", cpu);
+    json << ",\n";
+    writeTimes(json, "gpu_ms", gpu);
+    json << ",\n";
+    json << "  \"draws\": " << draws / frames << ",\n";
+    json << "  \"triangles\": " << triangles / frames << ",\n";
+    json << "  \"memory_peak_bytes\": {";
+    for (int i = 0; i < MEMORY_CATEGORIES; i++)
+        json << (i ? ", " : "") << "\"" << MemoryTracker::Name((MemoryCategory)i) << "\": " << memoryTracker.Peak((MemoryCategory)i);
+    json << "},\n";
+    json << "  \"over_memory_budget\": " << (memoryTracker.OverBudget() ? "true" : "false") << "\n";
+    json << "}\n";
+
+    std::sort(cpu.begin(), cpu.end());
+    std::sort(gpu.begin(), gpu.end());
+    std::cout << "benchmark: " << benchmarkResults.size() << " frames, cpu p50 " << percentile(cpu, 0.5f) << " p99 "
+        << percentile(cpu, 0.99f) << " ms, gpu p50 " << percentile(gpu, 0.5f) << " p99 " << percentile(gpu, 0.99f)
+        << " ms, " << draws / frames << " draws, " << triangles / frames << " triangles per frame" << std::endl;
+    std::cout << "results written to benchmark.csv, benchmark_passes.csv and benchmark.json" << std::endl;
+}
+
+// the last frame in total and per pass
+void printFrameStats()
+{
+    std::vector<std::pair<std::string, FrameStats> > rows;
+    rows.push_back(std::make_pair(std::string("frame"), lastFrameStats));
+    const std::vector<FrameStatsLog::Section>& passes = frameStatsLog.Last();
+    for (size_t i = 0; i < passes.size(); i++)
+        rows.push_back(std::make_pair(passes[i].name, passes[i].stats));
+
+    std::cout << std::left << std::setw(28) << "" << std::right << std::setw(8) << "draws" << std::setw(10) << "indices"
+        << std::setw(10) << "tris" << std::setw(10) << "programs" << std::setw(10) << "textures" << std::setw(10) << "uniforms"
+        << std::setw(10) << "bytes" << std::endl;
+    for (size_t i = 0; i < rows.size(); i++) {
+        const FrameStats& s = rows[i].second;
+        std::cout << std::left << std::setw(28) << rows[i].first << std::right << std::setw(8) << s.draws << std::setw(10)
+            << s.indices << std::setw(10) << s.triangles << std::setw(10) << s.programSwitches << std::setw(10) << s.textureBinds
+            << std::setw(10) << s.uniformUploads << std::setw(10) << s.bufferBytes << std::endl;
+    }
+}
+
+void setMemoryBudgets()
+{
+    memoryTracker.SetBudget(MEMORY_TEXTURES, TEXTURE_BUDGET);
+    memoryTracker.SetBudget(MEMORY_VERTEX_BUFFERS, VERTEX_BUFFER_BUDGET);
+    memoryTracker.SetBudget(MEMORY_INDEX_BUFFERS, INDEX_BUFFER_BUDGET);
+    memoryTracker.SetBudget(MEMORY_UNIFORM_BUFFERS, UNIFORM_BUFFER_BUDGET);
+    memoryTracker.SetBudget(MEMORY_RENDER_TARGETS, RENDER_TARGET_BUDGET);
+    memoryTracker.SetBudget(MEMORY_CPU_ASSETS, CPU_ASSET_BUDGET);
+}
+
+// deletes the models, the terrain and the other scene resources main created
+void releaseScene()
+{
+    for (unsigned int i = 0; i < props.size(); i++)
+        glDeleteQueries(2, props[i].queries);
+    props.clear();
+
+    delete backpack;
+    delete rum;
+    delete watchtower;
+    delete apple;
+    backpack = rum = watchtower = apple = nullptr;
+
+    GLuint textures[] = { heightmapID, heightNormalID, dirt, sand, grass, rock, snow };
+    for (unsigned int i = 0; i < 7; i++)
+        memoryTracker.UntrackTexture(textures[i]);
+    glState.DeleteTextures(7, textures);
+
+    for (unsigned int unit = 0; unit < MESH_TEXTURE_UNITS; unit++)
+        memoryTracker.UntrackTexture(defaultTextures[unit]);
+    glState.DeleteTextures(MESH_TEXTURE_UNITS, defaultTextures);
+
+    GLuint buffers[] = { terrainVBO, terrainEBO, terrainDepthVBO, occlusionBoxVBO, occlusionBoxEBO, quadVBO, frameUBO };
+    for (unsigned int i = 0; i < 7; i++)
+        memoryTracker.UntrackBuffer(buffers[i]);
+    glDeleteBuffers(7, buffers);
+
+    GLuint vertexArrays[] = { terrainVAO, terrainDepthVAO, occlusionBoxVAO, quadVAO, skyVAO };
+    glState.DeleteVertexArrays(5, vertexArrays);
+
+    memoryTracker.UntrackCpu(&terrainOccluderVertices);
+    std::vector<float>().swap(terrainOccluderVertices);
+    std::vector<unsigned int>().swap(terrainOccluderIndices);
+}
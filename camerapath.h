@@ -0,0 +1,131 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// camera keys recorded from an interactive session, played back as a Catmull-Rom spline through them.
+// saved as text, one "time x y z yaw pitch" key per line
+class CameraPath {
+public:
+    struct Key {
+        float time;
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+
+    void Clear()
+    {
+        keys.clear();
+    }
+
+    // yaw is unwrapped against the previous key so the spline turns the short way across +-180
+    void Add(float time, const glm::vec3& position, float yaw, float pitch)
+    {
+        if (!keys.empty()) {
+            float previous = keys.back().yaw;
+            while (yaw - previous > 180.0f) yaw -= 360.0f;
+            while (yaw - previous < -180.0f) yaw += 360.0f;
+        }
+
+        Key key;
+        key.time = time;
+        key.position = position;
+        key.yaw = yaw;
+        key.pitch = pitch;
+        keys.push_back(key);
+    }
+
+    bool Save(const char* path) const
+    {
+        std::ofstream file(path);
+        if (!file) {
+            std::cout << "ERROR: could not write camera path " << path << std::endl;
+            return false;
+        }
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            const Key& k = keys[i];
+            file << k.time << " " << k.position.x << " " << k.position.y << " " << k.position.z << " "
+                << k.yaw << " " << k.pitch << "\n";
+        }
+        return true;
+    }
+
+    bool Load(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file) {
+            std::cout << "ERROR: could not read camera path " << path << std::endl;
+            return false;
+        }
+
+        keys.clear();
+        Key k;
+        while (file >> k.time >> k.position.x >> k.position.y >> k.position.z >> k.yaw >> k.pitch)
+            keys.push_back(k);
+
+        if (keys.size() < 2) {
+            std::cout << "ERROR: camera path " << path << " needs at least two keys" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    size_t Size() const
+    {
+        return keys.size();
+    }
+
+    float Duration() const
+    {
+        return keys.empty() ? 0.0f : keys.back().time - keys.front().time;
+    }
+
+    // time is relative to the first key and clamped to the path, the returned yaw is not wrapped
+    void Sample(float time, glm::vec3& position, float& yaw, float& pitch) const
+    {
+        if (keys.empty())
+            return;
+
+        float t = keys.front().time + glm::clamp(time, 0.0f, Duration());
+
+        // segment i runs from key i to key i + 1
+        size_t i = std::upper_bound(keys.begin(), keys.end(), t, [](float value, const Key& key) {
+            return value < key.time;
+        }) - keys.begin();
+        i = std::min(i == 0 ? 0 : i - 1, keys.size() - 1);
+        size_t next = std::min(i + 1, keys.size() - 1);
+
+        const Key& k0 = keys[i == 0 ? 0 : i - 1];
+        const Key& k1 = keys[i];
+        const Key& k2 = keys[next];
+        const Key& k3 = keys[std::min(next + 1, keys.size() - 1)];
+
+        float span = k2.time - k1.time;
+        float u = span > 0.0f ? (t - k1.time) / span : 0.0f;
+
+        position = CatmullRom(k0.position, k1.position, k2.position, k3.position, u);
+        yaw = CatmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, u);
+        pitch = glm::clamp(CatmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, u), -90.0f, 90.0f);
+    }
+
+private:
+    vector<Key> keys;
+
+    // passes through p1 at u = 0 and p2 at u = 1
+    template <typename T>
+    static T CatmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float u)
+    {
+        float u2 = u * u;
+        float u3 = u2 * u;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 +
+            (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+    }
+};
+#endif
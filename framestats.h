@@ -0,0 +1,106 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+using namespace std;
+
+// what the renderer submitted to GL this frame, reset at the end of every frame
+struct FrameStats {
+    unsigned int draws;
+    unsigned int indices, triangles;
+    unsigned int programSwitches;
+    unsigned int textureBinds;
+    unsigned int uniformUploads;
+    size_t bufferBytes;
+};
+
+inline FrameStats operator-(const FrameStats& a, const FrameStats& b)
+{
+    FrameStats d;
+    d.draws = a.draws - b.draws;
+    d.indices = a.indices - b.indices;
+    d.triangles = a.triangles - b.triangles;
+    d.programSwitches = a.programSwitches - b.programSwitches;
+    d.textureBinds = a.textureBinds - b.textureBinds;
+    d.uniformUploads = a.uniformUploads - b.uniformUploads;
+    d.bufferBytes = a.bufferBytes - b.bufferBytes;
+    return d;
+}
+
+// defined in Graphics Programming.cpp
+extern FrameStats frameStats;
+
+// next to every GL_TRIANGLES draw call, count is its vertex or index count. conditional draws
+// are counted as submitted, the GPU may still skip them
+inline void CountDraw(GLsizei count)
+{
+    frameStats.draws++;
+    frameStats.indices += (unsigned int)count;
+    frameStats.triangles += (unsigned int)count / 3;
+}
+
+// next to every glUniform* call that reaches GL
+inline void CountUniform()
+{
+    frameStats.uniformUploads++;
+}
+
+// next to every per-frame buffer write
+inline void CountUpload(size_t bytes)
+{
+    frameStats.bufferBytes += bytes;
+}
+
+// frameStats split up by named sections. nested sections are named "parent/child" and also count in their parent,
+// sections are listed in the order they began
+class FrameStatsLog {
+public:
+    struct Section {
+        string name;
+        FrameStats stats;
+    };
+
+    void Begin(const char* name)
+    {
+        Section section;
+        section.name = open.empty() ? string(name) : current[open.back()].name + "/" + name;
+        section.stats = frameStats;
+
+        open.push_back(current.size());
+        current.push_back(section);
+    }
+
+    void End()
+    {
+        if (open.empty())
+            return;
+
+        Section& section = current[open.back()];
+        section.stats = frameStats - section.stats;
+        open.pop_back();
+    }
+
+    // the sections of this frame become Last()
+    void EndFrame()
+    {
+        last.swap(current);
+        current.clear();
+        open.clear();
+    }
+
+    const vector<Section>& Last() const
+    {
+        return last;
+    }
+
+private:
+    vector<Section> current, last;
+
+    // indices into current of the sections that began but haven't ended
+    vector<size_t> open;
+};
+#endif
@@ -0,0 +1,242 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+#include "framestats.h"
+
+// texture units shadowed by the cache, the terrain uses the most with 7
+#define GL_STATE_TEXTURE_UNITS 16
+
+// shadow copy of the OpenGL state the renderer changes. all rendering code sets state through here,
+// calls that would set the value that is already current never reach the driver.
+// code that changes the same state directly has to call Invalidate() afterwards
+class GLState {
+public:
+    struct Stats {
+        unsigned int issued, elided;
+    };
+
+    Stats stats;
+
+    GLState()
+    {
+        Invalidate();
+        ResetStats();
+    }
+
+    // everything unknown, the next call of each kind is always issued
+    void Invalidate()
+    {
+        depthTest = cullFace = blend = UNKNOWN;
+        depthMask = colorMask = UNKNOWN;
+        cullMode = depthFunc = blendSource = blendDestination = UNKNOWN;
+        program = vertexArray = framebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+            textures[i] = UNKNOWN;
+        for (int i = 0; i < 4; i++)
+            viewport[i] = -1;
+    }
+
+    void ResetStats()
+    {
+        stats = Stats();
+    }
+
+    // only depth test, face culling and blending are shadowed, other caps are passed through
+    void Enable(GLenum cap)
+    {
+        GLuint* shadow = Capability(cap);
+        if (!shadow || Changed(*shadow, GL_TRUE))
+            glEnable(cap);
+    }
+
+    void Disable(GLenum cap)
+    {
+        GLuint* shadow = Capability(cap);
+        if (!shadow || Changed(*shadow, GL_FALSE))
+            glDisable(cap);
+    }
+
+    void CullFace(GLenum mode)
+    {
+        if (Changed(cullMode, mode))
+            glCullFace(mode);
+    }
+
+    void DepthFunc(GLenum func)
+    {
+        if (Changed(depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    void DepthMask(GLboolean write)
+    {
+        if (Changed(depthMask, write))
+            glDepthMask(write);
+    }
+
+    void ColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+    {
+        GLuint mask = (r ? 1 : 0) | (g ? 2 : 0) | (b ? 4 : 0) | (a ? 8 : 0);
+        if (Changed(colorMask, mask))
+            glColorMask(r, g, b, a);
+    }
+
+    void BlendFunc(GLenum source, GLenum destination)
+    {
+        // both have to match, counted as one call
+        if (blendSource == source && blendDestination == destination) {
+            stats.elided++;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        stats.issued++;
+        glBlendFunc(source, destination);
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (Changed(program, id)) {
+            frameStats.programSwitches++;
+            glUseProgram(id);
+        }
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (Changed(vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    void BindFramebuffer(GLuint id)
+    {
+        if (Changed(framebuffer, id))
+            glBindFramebuffer(GL_FRAMEBUFFER, id);
+    }
+
+    void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+            stats.elided++;
+            return;
+        }
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+        stats.issued++;
+        glViewport(x, y, width, height);
+    }
+
+    // unit is an index, not GL_TEXTUREi
+    void ActiveTexture(GLuint unit)
+    {
+        if (Changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    // binds a GL_TEXTURE_2D to a unit, switching the active unit only when the binding changes
+    void BindTexture(GLuint unit, GLuint texture)
+    {
+        if (unit >= GL_STATE_TEXTURE_UNITS) {
+            ActiveTexture(unit);
+            stats.issued++;
+            frameStats.textureBinds++;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            return;
+        }
+
+        if (textures[unit] == texture) {
+            stats.elided++;
+            return;
+        }
+
+        ActiveTexture(unit);
+        textures[unit] = texture;
+        stats.issued++;
+        frameStats.textureBinds++;
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // deleting unbinds the object in GL and its name can be handed out again, so the shadow has to forget it too
+    void DeleteProgram(GLuint id)
+    {
+        if (program == id)
+            program = UNKNOWN;
+        glDeleteProgram(id);
+    }
+
+    void DeleteVertexArrays(GLsizei count, const GLuint* ids)
+    {
+        for (GLsizei i = 0; i < count; i++) {
+            if (vertexArray == ids[i])
+                vertexArray = 0;
+        }
+        glDeleteVertexArrays(count, ids);
+    }
+
+    void DeleteFramebuffers(GLsizei count, const GLuint* ids)
+    {
+        for (GLsizei i = 0; i < count; i++) {
+            if (framebuffer == ids[i])
+                framebuffer = 0;
+        }
+        glDeleteFramebuffers(count, ids);
+    }
+
+    void DeleteTextures(GLsizei count, const GLuint* ids)
+    {
+        for (GLsizei i = 0; i < count; i++) {
+            for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+                if (textures[unit] == ids[i])
+                    textures[unit] = 0;
+            }
+        }
+        glDeleteTextures(count, ids);
+    }
+
+private:
+    // no valid value of any of the shadowed state
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    GLuint depthTest, cullFace, blend;
+    GLuint depthMask, colorMask;
+    GLuint cullMode, depthFunc, blendSource, blendDestination;
+    GLuint program, vertexArray, framebuffer;
+    GLuint activeUnit;
+    GLuint textures[GL_STATE_TEXTURE_UNITS];
+    GLint viewport[4];
+
+    bool Changed(GLuint& current, GLuint value)
+    {
+        if (current == value) {
+            stats.elided++;
+            return false;
+        }
+        current = value;
+        stats.issued++;
+        return true;
+    }
+
+    GLuint* Capability(GLenum cap)
+    {
+        switch (cap) {
+        case GL_DEPTH_TEST:
+            return &depthTest;
+        case GL_CULL_FACE:
+            return &cullFace;
+        case GL_BLEND:
+            return &blend;
+        default:
+            stats.issued++;
+            return nullptr;
+        }
+    }
+};
+
+// defined in Graphics Programming.cpp
+extern GLState glState;
+#endif
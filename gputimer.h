@@ -0,0 +1,199 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// frames of queries in flight, a frame's results are read when its slot comes around again
+#define GPU_TIMER_FRAMES 3
+
+// frames averaged into one result
+#define GPU_TIMER_WINDOW 120
+
+// GPU time of named sections of the frame. Begin()/End() put a GL_TIMESTAMP query on each side, so sections
+// can nest and don't conflict with other timer queries. results are read GPU_TIMER_FRAMES - 1 frames later
+// and only when they are already available, a frame that isn't done by then is dropped instead of waited for.
+// nested sections are named "parent/child"
+class GpuTimer {
+public:
+    struct Section {
+        string name;
+
+        // per frame over the last complete window, 0 until the first one
+        float averageMs;
+
+        float sumMs;
+    };
+
+    unsigned int dropped;
+
+    GpuTimer() : dropped(0), slot(0), collected(0)
+    {
+        for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+            frames[i].used = 0;
+            frames[i].last = 0;
+        }
+    }
+
+    void Release()
+    {
+        for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+            if (!frames[i].queries.empty())
+                glDeleteQueries((GLsizei)frames[i].queries.size(), &frames[i].queries[0]);
+            frames[i].queries.clear();
+            frames[i].scopes.clear();
+            frames[i].used = 0;
+        }
+    }
+
+    // moves to the next slot, collecting what was timed in it GPU_TIMER_FRAMES frames ago
+    void BeginFrame()
+    {
+        slot = (slot + 1) % GPU_TIMER_FRAMES;
+        Frame& frame = frames[slot];
+        if (!frame.scopes.empty())
+            Collect(frame);
+
+        frame.scopes.clear();
+        frame.used = 0;
+        stack.clear();
+    }
+
+    // true when a new window of averages is ready
+    bool EndFrame()
+    {
+        bool ready = collected >= GPU_TIMER_WINDOW;
+        if (ready) {
+            for (size_t i = 0; i < sections.size(); i++) {
+                sections[i].averageMs = sections[i].sumMs / collected;
+                sections[i].sumMs = 0.0f;
+            }
+            collected = 0;
+        }
+        return ready;
+    }
+
+    void Begin(const char* name)
+    {
+        string path = stack.empty() ? string(name) : sections[frames[slot].scopes[stack.back()].section].name + "/" + name;
+
+        Frame& frame = frames[slot];
+        Scope scope;
+        scope.section = Find(path);
+        scope.begin = Query(frame);
+        scope.end = Query(frame);
+        glQueryCounter(scope.begin, GL_TIMESTAMP);
+
+        stack.push_back((unsigned int)frame.scopes.size());
+        frame.scopes.push_back(scope);
+    }
+
+    void End()
+    {
+        if (stack.empty())
+            return;
+
+        Frame& frame = frames[slot];
+        frame.last = frame.scopes[stack.back()].end;
+        glQueryCounter(frame.last, GL_TIMESTAMP);
+        stack.pop_back();
+    }
+
+    // averaged over the last window, 0 for sections that never ran
+    float Milliseconds(const char* name) const
+    {
+        for (size_t i = 0; i < sections.size(); i++) {
+            if (sections[i].name == name)
+                return sections[i].averageMs;
+        }
+        return 0.0f;
+    }
+
+    const vector<Section>& Sections() const
+    {
+        return sections;
+    }
+
+    // "name ms, name ms, ..." of the last window in the order the sections first ran
+    string Summary() const
+    {
+        string summary;
+        char buffer[32];
+        for (size_t i = 0; i < sections.size(); i++) {
+            snprintf(buffer, sizeof(buffer), " %.3f", sections[i].averageMs);
+            summary += (i ? ", " : "") + sections[i].name + buffer;
+        }
+        return summary;
+    }
+
+private:
+    struct Scope {
+        unsigned int section;
+        GLuint begin, end;
+    };
+
+    // queries are kept and reused, they only grow when a frame has more sections than any before
+    struct Frame {
+        vector<GLuint> queries;
+        vector<Scope> scopes;
+        size_t used;
+
+        // issued last, an outer section ends after the ones inside it
+        GLuint last;
+    };
+
+    Frame frames[GPU_TIMER_FRAMES];
+    unsigned int slot;
+    vector<Section> sections;
+    vector<unsigned int> stack;
+    unsigned int collected;
+
+    unsigned int Find(const string& name)
+    {
+        for (size_t i = 0; i < sections.size(); i++) {
+            if (sections[i].name == name)
+                return (unsigned int)i;
+        }
+
+        Section section;
+        section.name = name;
+        section.averageMs = 0.0f;
+        section.sumMs = 0.0f;
+        sections.push_back(section);
+        return (unsigned int)sections.size() - 1;
+    }
+
+    GLuint Query(Frame& frame)
+    {
+        if (frame.used == frame.queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        return frame.queries[frame.used++];
+    }
+
+    // timestamps complete in order, when the last one is available all of them are
+    void Collect(const Frame& frame)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.last, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            dropped++;
+            return;
+        }
+
+        for (size_t i = 0; i < frame.scopes.size(); i++) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame.scopes[i].begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.scopes[i].end, GL_QUERY_RESULT, &end);
+            sections[frame.scopes[i].section].sumMs += (end - begin) / 1000000.0f;
+        }
+        collected++;
+    }
+};
+#endif
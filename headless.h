@@ -0,0 +1,177 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include "memorytracker.h"
+
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// OpenGL 3.3 core context without a window or display, for the build and benchmark servers.
+// uses a surfaceless EGL context, which Mesa provides for llvmpipe too, so no GPU is needed.
+// there is no default framebuffer, the frame goes to Framebuffer() instead.
+// on Windows Create() fails, CMakeLists.txt builds the program on Linux against libEGL and libGL
+class HeadlessContext {
+public:
+    HeadlessContext() : framebuffer(0), color(0), depth(0)
+    {
+#ifndef _WIN32
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+#endif
+    }
+
+    // makes the context current, load the GL functions with ProcAddress afterwards
+    bool Create()
+    {
+#ifdef _WIN32
+        std::cout << "ERROR: headless mode needs EGL, it is not available on this platform" << std::endl;
+        return false;
+#else
+        // the surfaceless platform needs no X or Wayland server, fall back to the default display without it
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+                (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+            if (getPlatformDisplay)
+                display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            std::cout << "ERROR: could not initialize EGL" << std::endl;
+            return false;
+        }
+
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+            std::cout << "ERROR: EGL_KHR_surfaceless_context is not supported" << std::endl;
+            return false;
+        }
+
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            std::cout << "ERROR: no EGL config for desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            std::cout << "ERROR: EGL has no desktop OpenGL" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+            EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT) {
+            std::cout << "ERROR: could not create an OpenGL 3.3 core context" << std::endl;
+            return false;
+        }
+
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            std::cout << "ERROR: could not make the headless context current" << std::endl;
+            return false;
+        }
+
+        std::cout << "headless EGL " << major << "." << minor << ", " << eglQueryString(display, EGL_VENDOR) << std::endl;
+        return true;
+#endif
+    }
+
+    // stands in for the default framebuffer, call after the GL functions are loaded
+    void CreateTargets(int width, int height)
+    {
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        memoryTracker.TrackTexture(color, MEMORY_RENDER_TARGETS, MemoryTracker::TextureBytes(width, height, GL_RGBA8, false), "headless backbuffer");
+        memoryTracker.TrackRenderbuffer(depth, MEMORY_RENDER_TARGETS, MemoryTracker::TextureBytes(width, height, GL_DEPTH24_STENCIL8, false),
+            "headless backbuffer");
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR: headless framebuffer is not complete" << std::endl;
+
+        // set directly, the state cache is invalidated by the caller
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    void Release()
+    {
+        if (framebuffer) {
+            memoryTracker.UntrackTexture(color);
+            memoryTracker.UntrackRenderbuffer(depth);
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteTextures(1, &color);
+            glDeleteRenderbuffers(1, &depth);
+        }
+        framebuffer = color = depth = 0;
+
+#ifndef _WIN32
+        if (display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+        }
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+#endif
+    }
+
+    // 0 when not headless, so it can always be used as the backbuffer
+    GLuint Framebuffer() const
+    {
+        return framebuffer;
+    }
+
+    // loader for gladLoadGLLoader
+    static void* ProcAddress(const char* name)
+    {
+#ifdef _WIN32
+        return nullptr;
+#else
+        return (void*)eglGetProcAddress(name);
+#endif
+    }
+
+private:
+    GLuint framebuffer, color, depth;
+
+#ifndef _WIN32
+    EGLDisplay display;
+    EGLContext context;
+#endif
+};
+#endif
@@ -0,0 +1,290 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+using namespace std;
+
+enum MemoryCategory {
+    MEMORY_TEXTURES = 0,
+    MEMORY_VERTEX_BUFFERS,
+    MEMORY_INDEX_BUFFERS,
+    MEMORY_UNIFORM_BUFFERS,
+    MEMORY_RENDER_TARGETS,
+    MEMORY_CPU_ASSETS,
+    MEMORY_CATEGORIES
+};
+
+// bytes held by every live GL allocation and by the asset data kept on the CPU, per category and per asset.
+// GL sizes are computed from what was asked for, drivers add alignment and padding on top of that.
+// allocations are keyed by the object, tracking the same object again replaces its size. GL thread only
+class MemoryTracker {
+public:
+    struct Allocation {
+        MemoryCategory category;
+        size_t bytes;
+        string asset;
+    };
+
+    MemoryTracker()
+    {
+        for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+            totals[i] = peaks[i] = budgets[i] = 0;
+            warned[i] = false;
+        }
+    }
+
+    // texture names, buffer names and renderbuffer names can be equal, so each kind is tracked separately
+    void TrackTexture(GLuint id, MemoryCategory category, size_t bytes, const string& asset)
+    {
+        Add(Key(KIND_TEXTURE, id), category, bytes, asset);
+    }
+
+    void TrackBuffer(GLuint id, MemoryCategory category, size_t bytes, const string& asset)
+    {
+        Add(Key(KIND_BUFFER, id), category, bytes, asset);
+    }
+
+    void TrackRenderbuffer(GLuint id, MemoryCategory category, size_t bytes, const string& asset)
+    {
+        Add(Key(KIND_RENDERBUFFER, id), category, bytes, asset);
+    }
+
+    // owner is whatever holds the data and stays put while it does
+    void TrackCpu(const void* owner, size_t bytes, const string& asset)
+    {
+        Add(Key(KIND_CPU, (uintptr_t)owner), MEMORY_CPU_ASSETS, bytes, asset);
+    }
+
+    void UntrackTexture(GLuint id)
+    {
+        Remove(Key(KIND_TEXTURE, id));
+    }
+
+    void UntrackBuffer(GLuint id)
+    {
+        Remove(Key(KIND_BUFFER, id));
+    }
+
+    void UntrackRenderbuffer(GLuint id)
+    {
+        Remove(Key(KIND_RENDERBUFFER, id));
+    }
+
+    void UntrackCpu(const void* owner)
+    {
+        Remove(Key(KIND_CPU, (uintptr_t)owner));
+    }
+
+    size_t Total(MemoryCategory category) const
+    {
+        return totals[category];
+    }
+
+    // the most that was live at once since the start
+    size_t Peak(MemoryCategory category) const
+    {
+        return peaks[category];
+    }
+
+    // everything except the CPU assets
+    size_t GpuTotal() const
+    {
+        size_t total = 0;
+        for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+            if (i != MEMORY_CPU_ASSETS)
+                total += totals[i];
+        }
+        return total;
+    }
+
+    // 0 means no budget. a warning is printed the first time the category goes over it
+    void SetBudget(MemoryCategory category, size_t bytes)
+    {
+        budgets[category] = bytes;
+        warned[category] = false;
+        Check(category);
+    }
+
+    size_t Budget(MemoryCategory category) const
+    {
+        return budgets[category];
+    }
+
+    // true when any category has been over its budget at some point, not only right now
+    bool OverBudget() const
+    {
+        for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+            if (budgets[i] && peaks[i] > budgets[i])
+                return true;
+        }
+        return false;
+    }
+
+    // the totals per category, then every asset with what it holds in each category, largest first
+    void Report(std::ostream& out) const
+    {
+        out << std::left << std::setw(28) << "" << std::right << std::setw(12) << "live MB" << std::setw(12) << "peak MB"
+            << std::setw(12) << "budget MB" << std::endl;
+        for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+            out << std::left << std::setw(28) << Name((MemoryCategory)i) << std::right << std::setw(12) << Megabytes(totals[i])
+                << std::setw(12) << Megabytes(peaks[i]) << std::setw(12) << (budgets[i] ? Megabytes(budgets[i]) : string("-"))
+                << std::endl;
+        }
+        out << std::left << std::setw(28) << "gpu" << std::right << std::setw(12) << Megabytes(GpuTotal()) << std::endl;
+
+        // summed per asset and category
+        map<pair<string, int>, pair<size_t, unsigned int> > assets;
+        for (map<pair<int, uintptr_t>, Allocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it) {
+            pair<size_t, unsigned int>& asset = assets[make_pair(it->second.asset, (int)it->second.category)];
+            asset.first += it->second.bytes;
+            asset.second++;
+        }
+
+        vector<pair<size_t, pair<string, int> > > rows;
+        for (map<pair<string, int>, pair<size_t, unsigned int> >::const_iterator it = assets.begin(); it != assets.end(); ++it)
+            rows.push_back(make_pair(it->second.first, it->first));
+        std::sort(rows.rbegin(), rows.rend());
+
+        out << std::left << std::setw(40) << "asset" << std::setw(16) << "category" << std::right << std::setw(12) << "MB"
+            << std::setw(10) << "objects" << std::endl;
+        for (size_t i = 0; i < rows.size(); i++) {
+            const pair<size_t, unsigned int>& asset = assets.find(rows[i].second)->second;
+            out << std::left << std::setw(40) << rows[i].second.first << std::setw(16) << Name((MemoryCategory)rows[i].second.second)
+                << std::right << std::setw(12) << Megabytes(rows[i].first) << std::setw(10) << asset.second << std::endl;
+        }
+    }
+
+    static const char* Name(MemoryCategory category)
+    {
+        switch (category) {
+        case MEMORY_TEXTURES:
+            return "textures";
+        case MEMORY_VERTEX_BUFFERS:
+            return "vertex buffers";
+        case MEMORY_INDEX_BUFFERS:
+            return "index buffers";
+        case MEMORY_UNIFORM_BUFFERS:
+            return "uniform buffers";
+        case MEMORY_RENDER_TARGETS:
+            return "render targets";
+        case MEMORY_CPU_ASSETS:
+            return "cpu assets";
+        default:
+            return "?";
+        }
+    }
+
+    // of an internal format, three channel formats are counted as four because drivers pad them
+    static unsigned int BytesPerPixel(GLenum format)
+    {
+        switch (format) {
+        case GL_RED:
+        case GL_R8:
+            return 1;
+        case GL_RG:
+        case GL_RG8:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGBA16F:
+        case GL_RGB16F:
+            return 8;
+        case GL_RGBA32F:
+        case GL_RGB32F:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    // level 0 and, when mipmapped, every level below it down to 1x1
+    static size_t TextureBytes(int width, int height, GLenum format, bool mipmapped)
+    {
+        size_t bytes = 0;
+        while (true) {
+            bytes += (size_t)width * height * BytesPerPixel(format);
+            if (!mipmapped || (width == 1 && height == 1))
+                break;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        return bytes;
+    }
+
+private:
+    enum Kind {
+        KIND_TEXTURE,
+        KIND_BUFFER,
+        KIND_RENDERBUFFER,
+        KIND_CPU
+    };
+
+    map<pair<int, uintptr_t>, Allocation> allocations;
+    size_t totals[MEMORY_CATEGORIES];
+    size_t peaks[MEMORY_CATEGORIES];
+    size_t budgets[MEMORY_CATEGORIES];
+    bool warned[MEMORY_CATEGORIES];
+
+    static pair<int, uintptr_t> Key(Kind kind, uintptr_t id)
+    {
+        return make_pair((int)kind, id);
+    }
+
+    void Add(const pair<int, uintptr_t>& key, MemoryCategory category, size_t bytes, const string& asset)
+    {
+        Remove(key);
+
+        Allocation& allocation = allocations[key];
+        allocation.category = category;
+        allocation.bytes = bytes;
+        allocation.asset = asset;
+
+        totals[category] += bytes;
+        peaks[category] = std::max(peaks[category], totals[category]);
+        Check(category);
+    }
+
+    void Remove(const pair<int, uintptr_t>& key)
+    {
+        map<pair<int, uintptr_t>, Allocation>::iterator it = allocations.find(key);
+        if (it == allocations.end())
+            return;
+
+        totals[it->second.category] -= it->second.bytes;
+        allocations.erase(it);
+    }
+
+    void Check(MemoryCategory category)
+    {
+        if (!budgets[category] || totals[category] <= budgets[category]) {
+            warned[category] = false;
+            return;
+        }
+
+        if (!warned[category]) {
+            std::cout << "WARNING: " << Name(category) << " use " << Megabytes(totals[category]) << " MB, over the budget of "
+                << Megabytes(budgets[category]) << " MB" << std::endl;
+            warned[category] = true;
+        }
+    }
+
+    static string Megabytes(size_t bytes)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.2f", bytes / (1024.0 * 1024.0));
+        return buffer;
+    }
+};
+
+// defined in Graphics Programming.cpp
+extern MemoryTracker memoryTracker;
+#endif
@@ -6,12 +6,19 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "framestats.h"
+#include "glstate.h"
+#include "memorytracker.h"
+
 #include <string>
 #include <vector>
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
 
+// texture units used by the render queue, these match the samplers set up for modelProgram
+#define MESH_TEXTURE_UNITS 5
+
 struct Vertex {
     // position
     glm::vec3 Position;
@@ -42,16 +49,54 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    unsigned int indexCount;
+
+    // positions only, for the depth pre-pass
+    unsigned int depthVAO;
+
+    // texture bound to each fixed unit (0 if none) and an id shared by all meshes with the same texture set
+    unsigned int textureUnits[MESH_TEXTURE_UNITS];
+    unsigned int materialID;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // asset names the buffers in the memory report
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, const string& asset = "mesh")
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        indexCount = (unsigned int)indices.size();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(asset);
+        setupMaterial();
+    }
+
+    // meshes are copied around by value, so the GL objects are only deleted when this is called.
+    // the textures belong to the model
+    void Release()
+    {
+        memoryTracker.UntrackBuffer(VBO);
+        memoryTracker.UntrackBuffer(EBO);
+        memoryTracker.UntrackBuffer(positionVBO);
+        glState.DeleteVertexArrays(1, &VAO);
+        glState.DeleteVertexArrays(1, &depthVAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &positionVBO);
+        VAO = depthVAO = VBO = EBO = positionVBO = 0;
+    }
+
+    // the GPU has its own copy, only the CPU occlusion culling reads these after the upload
+    void ReleaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    size_t CpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
     }
 
     // render the mesh
@@ -66,7 +111,6 @@ public:
         unsigned int ambientOcclusionNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -86,31 +130,28 @@ public:
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(program, (name + number).c_str()), i);
             // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            glState.BindTexture(i, textures[i].id);
         }
 
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        glState.BindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indexCount), GL_UNSIGNED_INT, 0);
+        CountDraw((GLsizei)indexCount);
     }
 
 private:
     // render data 
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, positionVBO;
 
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const string& asset)
     {
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        glState.BindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -120,6 +161,8 @@ private:
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        memoryTracker.TrackBuffer(VBO, MEMORY_VERTEX_BUFFERS, vertices.size() * sizeof(Vertex), asset);
+        memoryTracker.TrackBuffer(EBO, MEMORY_INDEX_BUFFERS, indices.size() * sizeof(unsigned int), asset);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -144,7 +187,54 @@ private:
         // weights
         glEnableVertexAttribArray(6);
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        glState.BindVertexArray(0);
+
+        // tightly packed copy of the positions sharing the index buffer, so depth-only draws fetch 12 bytes per vertex
+        vector<glm::vec3> positions(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+
+        glState.BindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        memoryTracker.TrackBuffer(positionVBO, MEMORY_VERTEX_BUFFERS, positions.size() * sizeof(glm::vec3), asset);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glState.BindVertexArray(0);
+    }
+
+    // maps the first texture of each type to its fixed unit (diffuse, specular, normal, roughness, ao)
+    void setupMaterial()
+    {
+        const char* unitTypes[MESH_TEXTURE_UNITS] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_roughness", "texture_ao" };
+
+        for (unsigned int unit = 0; unit < MESH_TEXTURE_UNITS; unit++) {
+            textureUnits[unit] = 0;
+            for (unsigned int i = 0; i < textures.size(); i++) {
+                if (textures[i].type == unitTypes[unit]) {
+                    textureUnits[unit] = textures[i].id;
+                    break;
+                }
+            }
+        }
+
+        // meshes that bind the exact same textures share a material id, so the render queue can group them
+        static vector<vector<unsigned int>> materials;
+        vector<unsigned int> material(textureUnits, textureUnits + MESH_TEXTURE_UNITS);
+
+        materialID = (unsigned int)materials.size();
+        for (unsigned int i = 0; i < materials.size(); i++) {
+            if (materials[i] == material) {
+                materialID = i;
+                return;
+            }
+        }
+        materials.push_back(material);
     }
 };
 #endif
\ No newline at end of file
@@ -10,8 +10,11 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "memorytracker.h"
 #include "mesh.h"
+#include "profiler.h"
 
+#include <cfloat>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -29,14 +32,38 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh>    meshes;
     string directory;
+    string path;
     bool gammaCorrection;
 
+    // object space bounding box over all meshes
+    glm::vec3 boundsMin, boundsMax;
+
     // constructor, expects a filepath to a 3D model.
     Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
     {
         loadModel(path);
     }
 
+    // deletes the meshes and every texture they use
+    ~Model()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Release();
+        for (unsigned int i = 0; i < textures_loaded.size(); i++) {
+            memoryTracker.UntrackTexture(textures_loaded[i].id);
+            glState.DeleteTextures(1, &textures_loaded[i].id);
+        }
+        memoryTracker.UntrackCpu(this);
+    }
+
+    // for models that aren't rasterized as occluders, the vertices and indices are only needed for the upload and the bounds
+    void ReleaseCpuData()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].ReleaseCpuData();
+        memoryTracker.UntrackCpu(this);
+    }
+
     // draws the model, and thus all its meshes
     void Draw(unsigned int shader)
     {
@@ -48,6 +75,8 @@ private:
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const& path)
     {
+        PROFILE_SCOPE("Model::loadModel", path);
+
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -59,9 +88,28 @@ private:
         }
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
+        this->path = path;
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        computeBounds();
+
+        size_t cpuBytes = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            cpuBytes += meshes[i].CpuBytes();
+        memoryTracker.TrackCpu(this, cpuBytes, path);
+    }
+
+    void computeBounds()
+    {
+        boundsMin = glm::vec3(FLT_MAX);
+        boundsMax = glm::vec3(-FLT_MAX);
+        for (unsigned int i = 0; i < meshes.size(); i++) {
+            for (unsigned int v = 0; v < meshes[i].vertices.size(); v++) {
+                boundsMin = glm::min(boundsMin, meshes[i].vertices[v].Position);
+                boundsMax = glm::max(boundsMax, meshes[i].vertices[v].Position);
+            }
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -85,6 +133,8 @@ private:
 
     Mesh processMesh(aiMesh* mesh, const aiScene* scene)
     {
+        PROFILE_SCOPE("Model::processMesh");
+
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
@@ -170,7 +220,7 @@ private:
         textures.insert(textures.end(), aoMaps.begin(), aoMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return Mesh(vertices, indices, textures, path);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -210,6 +260,8 @@ private:
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)
 {
+    PROFILE_SCOPE("TextureFromFile", string(path));
+
     string filename = string(path);
     filename = directory + '/' + filename;
 
@@ -228,9 +280,10 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glState.BindTexture(0, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        memoryTracker.TrackTexture(textureID, MEMORY_TEXTURES, MemoryTracker::TextureBytes(width, height, format, true), filename);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -0,0 +1,282 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+// events kept per thread, the oldest are overwritten once a thread records more between two writes
+#define PROFILER_EVENTS (1 << 14)
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+// times the rest of the enclosing block: PROFILE_SCOPE("name") or PROFILE_SCOPE("name", detail)
+#define PROFILE_SCOPE(...) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(__VA_ARGS__)
+
+// CPU scope profiler. every thread records into its own buffer without locking, Write() saves what was recorded
+// since Start() as Chrome trace JSON, for about:tracing or ui.perfetto.dev. names and details have to outlive the
+// recording, string literals or Intern(). recording is on from the start so the loading is captured
+class Profiler {
+public:
+    struct Event {
+        const char* name;
+        const char* detail;
+        int64_t begin, end;
+    };
+
+    // nanoseconds since the profiler was first used
+    static int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Get().epoch).count();
+    }
+
+    static bool Enabled()
+    {
+        return Get().enabled.load(std::memory_order_relaxed);
+    }
+
+    // starts a new recording, Write() leaves out everything before this
+    static void Start()
+    {
+        State& state = Get();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (size_t i = 0; i < state.buffers.size(); i++)
+            state.buffers[i]->start = state.buffers[i]->count.load(std::memory_order_acquire);
+        state.enabled = true;
+    }
+
+    static void Stop()
+    {
+        Get().enabled = false;
+    }
+
+    // shows up as the thread's name in the trace, Write() may be reading the names meanwhile
+    static void SetThreadName(const char* name)
+    {
+        ThreadBuffer& buffer = Buffer();
+        std::lock_guard<std::mutex> lock(Get().mutex);
+        buffer.name = name;
+    }
+
+    // a copy of text that lives as long as the program, equal strings share one copy
+    static const char* Intern(const string& text)
+    {
+        State& state = Get();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.strings.insert(text).first->c_str();
+    }
+
+    static void Record(const char* name, const char* detail, int64_t begin, int64_t end)
+    {
+        ThreadBuffer& buffer = Buffer();
+        size_t index = buffer.count.load(std::memory_order_relaxed);
+
+        // claims the slot before overwriting it, so Write() can tell which of its copies were overwritten meanwhile
+        buffer.claimed.store(index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Slot& slot = buffer.events[index % PROFILER_EVENTS];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.detail.store(detail, std::memory_order_relaxed);
+        slot.begin.store(begin, std::memory_order_relaxed);
+        slot.end.store(end, std::memory_order_relaxed);
+
+        // publishes the event to Write() on another thread
+        buffer.count.store(index + 1, std::memory_order_release);
+    }
+
+    // complete events of every thread since Start(), threads can keep recording meanwhile
+    static bool Write(const char* path)
+    {
+        std::ofstream file(path);
+        if (!file) {
+            std::cout << "ERROR: could not write trace " << path << std::endl;
+            return false;
+        }
+
+        State& state = Get();
+        std::lock_guard<std::mutex> lock(state.mutex);
+
+        size_t written = 0;
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        for (size_t i = 0; i < state.buffers.size(); i++) {
+            ThreadBuffer& buffer = *state.buffers[i];
+            file << (i ? ",\n" : "") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id
+                << ",\"args\":{\"name\":\"" << Escape(buffer.name) << "\"}}";
+
+            // copied out first, the thread may overwrite the oldest slots while they are read
+            size_t count = buffer.count.load(std::memory_order_acquire);
+            size_t first = std::max(buffer.start, count > PROFILER_EVENTS ? count - PROFILER_EVENTS : 0);
+            vector<Event> events;
+            events.reserve(count - first);
+            for (size_t e = first; e < count; e++) {
+                const Slot& slot = buffer.events[e % PROFILER_EVENTS];
+                Event event;
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.detail = slot.detail.load(std::memory_order_relaxed);
+                event.begin = slot.begin.load(std::memory_order_relaxed);
+                event.end = slot.end.load(std::memory_order_relaxed);
+                events.push_back(event);
+            }
+
+            // every copy of a slot that was claimed again since could mix two events, those are dropped
+            std::atomic_thread_fence(std::memory_order_acquire);
+            size_t claimed = buffer.claimed.load(std::memory_order_relaxed);
+            size_t overwritten = claimed > PROFILER_EVENTS ? std::min(claimed - PROFILER_EVENTS, count) : 0;
+            if (overwritten > first)
+                events.erase(events.begin(), events.begin() + (overwritten - first));
+
+            for (size_t e = 0; e < events.size(); e++) {
+                const Event& event = events[e];
+
+                // microseconds with nanosecond decimals
+                char times[64];
+                snprintf(times, sizeof(times), "%.3f,\"dur\":%.3f", event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+
+                file << ",\n{\"name\":\"" << Escape(event.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id
+                    << ",\"ts\":" << times;
+                if (event.detail)
+                    file << ",\"args\":{\"detail\":\"" << Escape(event.detail) << "\"}";
+                file << "}";
+            }
+            written += events.size();
+        }
+        file << "\n]}\n";
+
+        std::cout << "trace of " << written << " events from " << state.buffers.size() << " threads written to " << path << std::endl;
+        return true;
+    }
+
+private:
+    // an event as it is stored, Write() reads it while the thread can be overwriting it
+    struct Slot {
+        std::atomic<const char*> name;
+        std::atomic<const char*> detail;
+        std::atomic<int64_t> begin, end;
+    };
+
+    struct ThreadBuffer {
+        unsigned int id;
+        string name;
+        unique_ptr<Slot[]> events;
+        std::atomic<size_t> count;
+        std::atomic<size_t> claimed;
+        size_t start;
+    };
+
+    struct State {
+        std::mutex mutex;
+        vector<unique_ptr<ThreadBuffer>> buffers;
+        set<string> strings;
+        std::atomic<bool> enabled;
+        std::chrono::steady_clock::time_point epoch;
+
+        State() : enabled(true), epoch(std::chrono::steady_clock::now()) {}
+    };
+
+    static State& Get()
+    {
+        static State state;
+        return state;
+    }
+
+    // created on the first event of a thread, the only time recording takes the lock
+    static ThreadBuffer& Buffer()
+    {
+        static thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            State& state = Get();
+            std::lock_guard<std::mutex> lock(state.mutex);
+
+            unique_ptr<ThreadBuffer> created(new ThreadBuffer());
+            created->id = (unsigned int)state.buffers.size() + 1;
+            created->name = "thread " + std::to_string(created->id);
+            created->events.reset(new Slot[PROFILER_EVENTS]);
+            created->count = 0;
+            created->claimed = 0;
+            created->start = 0;
+            buffer = created.get();
+            state.buffers.push_back(std::move(created));
+        }
+        return *buffer;
+    }
+
+    // for a JSON string, control characters become \n, \t or \u00XX
+    static string Escape(const string& text)
+    {
+        string escaped;
+        for (size_t i = 0; i < text.size(); i++) {
+            unsigned char c = (unsigned char)text[i];
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += (char)c;
+            }
+            else if (c == '\n') {
+                escaped += "\\n";
+            }
+            else if (c == '\t') {
+                escaped += "\\t";
+            }
+            else if (c < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                escaped += code;
+            }
+            else {
+                escaped += (char)c;
+            }
+        }
+        return escaped;
+    }
+};
+
+// records the time from construction to the end of the scope, does nothing while the profiler is stopped
+class ProfileScope {
+public:
+    ProfileScope(const char* name, const char* detail = nullptr) : name(name), detail(detail), begin(-1)
+    {
+        if (Profiler::Enabled())
+            begin = Profiler::Now();
+    }
+
+    // detail is copied under the profiler lock, only while recording. not for code that runs every frame
+    ProfileScope(const char* name, const string& detail) : name(name), detail(nullptr), begin(-1)
+    {
+        if (Profiler::Enabled()) {
+            this->detail = Profiler::Intern(detail);
+            begin = Profiler::Now();
+        }
+    }
+
+    // for names that don't outlive the scope, copied under the lock like the detail above
+    ProfileScope(const string& name) : name(nullptr), detail(nullptr), begin(-1)
+    {
+        if (Profiler::Enabled()) {
+            this->name = Profiler::Intern(name);
+            begin = Profiler::Now();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (begin >= 0)
+            Profiler::Record(name, detail, begin, Profiler::Now());
+    }
+
+private:
+    const char* name;
+    const char* detail;
+    int64_t begin;
+};
+#endif
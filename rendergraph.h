@@ -0,0 +1,482 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <glad/glad.h>
+
+#include "framestats.h"
+#include "glstate.h"
+#include "gputimer.h"
+#include "memorytracker.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// handle to a texture inside the graph, only valid for the frame it was created in
+typedef int RGHandle;
+#define RG_NONE -1
+
+// what a pass needs from the previous contents of a target it writes to
+enum RGLoadOp {
+    RG_DONT_CARE = 0,   // every pixel gets overwritten, no clear
+    RG_CLEAR = 1,       // cleared to zero (color) or one (depth) before the pass
+    RG_LOAD = 2         // blends onto or modifies what an earlier pass wrote
+};
+
+struct RGTextureDesc {
+    int width, height;
+    GLenum format;
+
+    bool operator==(const RGTextureDesc& other) const
+    {
+        return width == other.width && height == other.height && format == other.format;
+    }
+};
+
+// frame graph for the fullscreen and scene passes. passes are declared every frame with the textures
+// they read and write, then Compile() culls passes that don't contribute to the backbuffer and assigns
+// pooled textures, reusing one for several resources when their lifetimes don't overlap.
+class RenderGraph {
+public:
+    typedef std::function<void(const RenderGraph& graph)> ExecuteFunc;
+
+    struct Stats {
+        unsigned int passes, culled;
+        unsigned int clears;
+        unsigned int resources, textures, aliased;
+        size_t poolBytes;
+    };
+
+    Stats stats;
+
+    RenderGraph() : frame(0), timer(nullptr), statsLog(nullptr)
+    {
+        stats = Stats();
+    }
+
+    // times every executed pass under its name, passes sharing a name add up
+    void SetTimer(GpuTimer* gpuTimer)
+    {
+        timer = gpuTimer;
+    }
+
+    // counts what every executed pass submitted, like SetTimer()
+    void SetStatsLog(FrameStatsLog* log)
+    {
+        statsLog = log;
+    }
+
+    // forgets the passes and resources of the last frame, pooled textures are kept
+    void Reset()
+    {
+        passes.clear();
+        resources.clear();
+        frame++;
+    }
+
+    // the default framebuffer, or the one standing in for it without a window. passes writing to it are never culled
+    RGHandle ImportBackbuffer(int width, int height, GLuint framebuffer = 0)
+    {
+        Resource resource;
+        resource.name = "backbuffer";
+        resource.framebuffer = framebuffer;
+        resource.desc.width = width;
+        resource.desc.height = height;
+        resource.desc.format = GL_NONE;
+        resource.imported = true;
+        resources.push_back(resource);
+        return (RGHandle)resources.size() - 1;
+    }
+
+    // a texture that only lives for this frame, its storage comes from the pool during Compile()
+    RGHandle CreateTexture(const char* name, int width, int height, GLenum format)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.desc.width = width;
+        resource.desc.height = height;
+        resource.desc.format = format;
+        resources.push_back(resource);
+        return (RGHandle)resources.size() - 1;
+    }
+
+    // name has to outlive the frame, a string literal. the profiler keeps the pointer instead of copying it
+    int AddPass(const char* name, ExecuteFunc execute)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.label = name;
+        pass.execute = execute;
+        passes.push_back(pass);
+        return (int)passes.size() - 1;
+    }
+
+    void Read(int pass, RGHandle resource)
+    {
+        if (resource != RG_NONE)
+            passes[pass].reads.push_back(resource);
+    }
+
+    // attachments are bound in the order they are written, depth formats go to the depth attachment
+    void Write(int pass, RGHandle resource, RGLoadOp load)
+    {
+        if (resource == RG_NONE)
+            return;
+
+        Attachment attachment;
+        attachment.resource = resource;
+        attachment.load = load;
+        passes[pass].writes.push_back(attachment);
+    }
+
+    void Compile()
+    {
+        Cull();
+
+        // lifetime of every resource in pass indices, among the passes that survived
+        for (size_t p = 0; p < passes.size(); p++) {
+            if (passes[p].culled)
+                continue;
+
+            for (size_t i = 0; i < passes[p].reads.size(); i++)
+                Touch(passes[p].reads[i], (int)p);
+            for (size_t i = 0; i < passes[p].writes.size(); i++)
+                Touch(passes[p].writes[i].resource, (int)p);
+        }
+
+        stats.resources = 0;
+        stats.textures = 0;
+        stats.aliased = 0;
+        for (size_t i = 0; i < pool.size(); i++)
+            pool[i].busy = false;
+
+        // hands out pool textures in pass order, a texture is free again after the last pass using it
+        for (size_t p = 0; p < passes.size(); p++) {
+            for (size_t r = 0; r < resources.size(); r++) {
+                if (!resources[r].imported && resources[r].firstPass == (int)p)
+                    Acquire(resources[r]);
+            }
+            for (size_t r = 0; r < resources.size(); r++) {
+                if (!resources[r].imported && resources[r].lastPass == (int)p)
+                    pool[resources[r].poolIndex].busy = false;
+            }
+        }
+
+        Trim();
+    }
+
+    void Execute()
+    {
+        stats.clears = 0;
+
+        for (size_t p = 0; p < passes.size(); p++) {
+            Pass& pass = passes[p];
+            if (pass.culled)
+                continue;
+
+            PROFILE_SCOPE(pass.label);
+            if (timer)
+                timer->Begin(pass.name.c_str());
+            if (statsLog)
+                statsLog->Begin(pass.name.c_str());
+
+            Bind(pass);
+            pass.execute(*this);
+
+            if (statsLog)
+                statsLog->End();
+            if (timer)
+                timer->End();
+        }
+
+        glState.BindFramebuffer(0);
+    }
+
+    // GL texture behind a handle, valid inside the execute functions
+    GLuint Texture(RGHandle resource) const
+    {
+        const Resource& r = resources[resource];
+        return r.imported ? 0 : pool[r.poolIndex].texture;
+    }
+
+    int Width(RGHandle resource) const
+    {
+        return resources[resource].desc.width;
+    }
+
+    int Height(RGHandle resource) const
+    {
+        return resources[resource].desc.height;
+    }
+
+    // deletes every pooled texture and framebuffer
+    void Release()
+    {
+        for (size_t i = 0; i < pool.size(); i++) {
+            memoryTracker.UntrackTexture(pool[i].texture);
+            glState.DeleteTextures(1, &pool[i].texture);
+        }
+        pool.clear();
+
+        for (map<vector<GLuint>, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end(); ++it)
+            glState.DeleteFramebuffers(1, &it->second);
+        framebuffers.clear();
+        stats.poolBytes = 0;
+    }
+
+private:
+    struct Resource {
+        string name;
+        RGTextureDesc desc;
+        bool imported;
+        GLuint framebuffer;
+        int firstPass, lastPass;
+        int poolIndex;
+
+        Resource() : imported(false), framebuffer(0), firstPass(-1), lastPass(-1), poolIndex(-1) {}
+    };
+
+    struct Attachment {
+        RGHandle resource;
+        RGLoadOp load;
+    };
+
+    struct Pass {
+        string name;
+        const char* label;
+        vector<RGHandle> reads;
+        vector<Attachment> writes;
+        ExecuteFunc execute;
+        bool culled;
+
+        Pass() : label(nullptr), culled(false) {}
+    };
+
+    struct PoolTexture {
+        GLuint texture;
+        RGTextureDesc desc;
+        bool busy;
+        unsigned int lastFrame;
+    };
+
+    // pooled textures are deleted after going unused for this many frames, e.g. after a resize
+    static const unsigned int POOL_FRAMES = 3;
+
+    vector<Pass> passes;
+    vector<Resource> resources;
+    vector<PoolTexture> pool;
+    map<vector<GLuint>, GLuint> framebuffers;
+    unsigned int frame;
+    GpuTimer* timer;
+    FrameStatsLog* statsLog;
+
+    // walks the passes backwards, keeping only the ones whose output is needed by a later kept pass
+    void Cull()
+    {
+        vector<bool> needed(resources.size(), false);
+        for (size_t r = 0; r < resources.size(); r++)
+            needed[r] = resources[r].imported;
+
+        stats.passes = 0;
+        stats.culled = 0;
+        for (int p = (int)passes.size() - 1; p >= 0; p--) {
+            Pass& pass = passes[p];
+
+            pass.culled = true;
+            for (size_t i = 0; i < pass.writes.size(); i++) {
+                if (needed[pass.writes[i].resource])
+                    pass.culled = false;
+            }
+
+            if (pass.culled) {
+                stats.culled++;
+                continue;
+            }
+            stats.passes++;
+
+            // earlier contents only matter when this pass loads them
+            for (size_t i = 0; i < pass.writes.size(); i++) {
+                RGHandle r = pass.writes[i].resource;
+                if (!resources[r].imported)
+                    needed[r] = pass.writes[i].load == RG_LOAD;
+            }
+            for (size_t i = 0; i < pass.reads.size(); i++)
+                needed[pass.reads[i]] = true;
+        }
+    }
+
+    void Touch(RGHandle resource, int pass)
+    {
+        Resource& r = resources[resource];
+        if (r.firstPass < 0)
+            r.firstPass = pass;
+        r.lastPass = pass;
+    }
+
+    void Acquire(Resource& resource)
+    {
+        stats.resources++;
+
+        for (size_t i = 0; i < pool.size(); i++) {
+            if (pool[i].busy || !(pool[i].desc == resource.desc))
+                continue;
+
+            // already handed out earlier this frame, so this resource shares memory with another one
+            if (pool[i].lastFrame == frame)
+                stats.aliased++;
+            else
+                stats.textures++;
+
+            pool[i].busy = true;
+            pool[i].lastFrame = frame;
+            resource.poolIndex = (int)i;
+            return;
+        }
+
+        PoolTexture entry;
+        entry.desc = resource.desc;
+        entry.busy = true;
+        entry.lastFrame = frame;
+
+        bool depth = IsDepth(resource.desc.format);
+        glGenTextures(1, &entry.texture);
+        glState.BindTexture(0, entry.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, resource.desc.format, resource.desc.width, resource.desc.height, 0,
+            depth ? GL_DEPTH_COMPONENT : (resource.desc.format == GL_R11F_G11F_B10F ? GL_RGB : GL_RGBA), GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glState.BindTexture(0, 0);
+        memoryTracker.TrackTexture(entry.texture, MEMORY_RENDER_TARGETS,
+            MemoryTracker::TextureBytes(resource.desc.width, resource.desc.height, resource.desc.format, false), "render graph pool");
+
+        pool.push_back(entry);
+        resource.poolIndex = (int)pool.size() - 1;
+        stats.textures++;
+    }
+
+    // frees textures that haven't been used for a few frames, together with their framebuffers
+    void Trim()
+    {
+        for (size_t i = 0; i < pool.size();) {
+            if (frame - pool[i].lastFrame <= POOL_FRAMES) {
+                i++;
+                continue;
+            }
+
+            GLuint texture = pool[i].texture;
+            for (map<vector<GLuint>, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end();) {
+                if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end()) {
+                    glState.DeleteFramebuffers(1, &it->second);
+                    it = framebuffers.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+
+            memoryTracker.UntrackTexture(texture);
+            glState.DeleteTextures(1, &texture);
+            pool.erase(pool.begin() + i);
+
+            // indices into the pool moved
+            for (size_t r = 0; r < resources.size(); r++) {
+                if (resources[r].poolIndex > (int)i)
+                    resources[r].poolIndex--;
+            }
+        }
+
+        stats.poolBytes = 0;
+        for (size_t i = 0; i < pool.size(); i++)
+            stats.poolBytes += (size_t)pool[i].desc.width * pool[i].desc.height * MemoryTracker::BytesPerPixel(pool[i].desc.format);
+    }
+
+    // binds the framebuffer for the pass outputs, sets the viewport to their size and clears what was asked for
+    void Bind(const Pass& pass)
+    {
+        vector<GLuint> attachments;
+        GLbitfield clearMask = 0;
+        int width = 0, height = 0;
+        bool backbuffer = false;
+        GLuint backbufferFBO = 0;
+
+        for (size_t i = 0; i < pass.writes.size(); i++) {
+            const Resource& r = resources[pass.writes[i].resource];
+            width = r.desc.width;
+            height = r.desc.height;
+
+            if (r.imported) {
+                backbuffer = true;
+                backbufferFBO = r.framebuffer;
+                continue;
+            }
+
+            attachments.push_back(pool[r.poolIndex].texture);
+
+            // a load on the first write has nothing to load, the contents are undefined either way
+            if (pass.writes[i].load == RG_CLEAR)
+                clearMask |= IsDepth(r.desc.format) ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT;
+        }
+
+        if (backbuffer)
+            glState.BindFramebuffer(backbufferFBO);
+        else
+            glState.BindFramebuffer(Framebuffer(pass, attachments));
+
+        glState.Viewport(0, 0, width, height);
+
+        if (clearMask) {
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClearDepth(1.0f);
+            glClear(clearMask);
+            stats.clears++;
+        }
+    }
+
+    GLuint Framebuffer(const Pass& pass, const vector<GLuint>& attachments)
+    {
+        map<vector<GLuint>, GLuint>::iterator found = framebuffers.find(attachments);
+        if (found != framebuffers.end())
+            return found->second;
+
+        GLuint fbo;
+        glGenFramebuffers(1, &fbo);
+        glState.BindFramebuffer(fbo);
+
+        GLenum drawBuffers[8];
+        GLsizei colorCount = 0;
+        for (size_t i = 0; i < pass.writes.size(); i++) {
+            const Resource& r = resources[pass.writes[i].resource];
+            if (r.imported)
+                continue;
+
+            if (IsDepth(r.desc.format)) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, pool[r.poolIndex].texture, 0);
+            }
+            else {
+                drawBuffers[colorCount] = GL_COLOR_ATTACHMENT0 + colorCount;
+                glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[colorCount], GL_TEXTURE_2D, pool[r.poolIndex].texture, 0);
+                colorCount++;
+            }
+        }
+        glDrawBuffers(colorCount, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "framebuffer for pass " << pass.name << " not complete" << std::endl;
+
+        framebuffers[attachments] = fbo;
+        return fbo;
+    }
+
+    static bool IsDepth(GLenum format)
+    {
+        return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F;
+    }
+};
+#endif
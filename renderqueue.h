@@ -0,0 +1,315 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "memorytracker.h"
+#include "mesh.h"
+#include "ringbuffer.h"
+#include "shader.h"
+
+// passes are stored in the top bits of the sort key, so they are always submitted in this order
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1
+};
+
+// per-draw data, laid out like the DrawData uniform block (std140)
+struct DrawData {
+    glm::mat4 world;
+};
+
+// one recorded draw, the sort key decides the order in which they are drawn.
+// recording never calls GL, so queues can be filled on worker threads and merged on the GL thread
+struct DrawItem {
+    uint64_t key;
+    const Shader* program;
+    GLuint vao, depthVAO;
+
+    // index range, first is a byte offset into the element buffer
+    GLsizei count;
+    size_t first;
+
+    // MESH_TEXTURE_UNITS textures bound before the draw, nullptr when the caller binds them itself
+    const unsigned int* textures;
+
+    // byte offset of the item's DrawData in the queue's uniform buffer
+    size_t drawData;
+
+    // occlusion query the draw is conditional on, 0 to always draw
+    GLuint condition;
+};
+
+class RenderQueue {
+public:
+    RenderQueue() : alignment(256), buffer(0), dataBuffer(0), dataOffset(0)
+    {
+        for (unsigned int unit = 0; unit < MESH_TEXTURE_UNITS; unit++)
+            defaultTextures[unit] = 0;
+        Clear();
+    }
+
+    // bound on the units an item has no texture for, otherwise those samplers would read whatever was bound last
+    void SetDefaultTextures(const unsigned int textures[MESH_TEXTURE_UNITS])
+    {
+        for (unsigned int unit = 0; unit < MESH_TEXTURE_UNITS; unit++)
+            defaultTextures[unit] = textures[unit];
+    }
+
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, every DrawData starts on a multiple of it.
+    // queues that are appended to each other must use the same value
+    void SetAlignment(size_t offsetAlignment)
+    {
+        alignment = offsetAlignment;
+    }
+
+    // key layout (msb -> lsb): pass 4 bits | program 12 bits | material 24 bits | depth 24 bits
+    static uint64_t MakeKey(RenderPass pass, GLuint program, unsigned int material, float depth)
+    {
+        depth = glm::clamp(depth, 0.0f, 1.0f);
+
+        // transparent surfaces are drawn back to front, everything else front to back
+        if (pass == PASS_TRANSPARENT)
+            depth = 1.0f - depth;
+
+        uint64_t depthBits = (uint64_t)(depth * 0xFFFFFF);
+        return ((uint64_t)(pass & 0xF) << 60) |
+            ((uint64_t)(program & 0xFFF) << 48) |
+            ((uint64_t)(material & 0xFFFFFF) << 24) |
+            depthBits;
+    }
+
+    void Push(uint64_t key, const Shader* program, Mesh* mesh, const glm::mat4& world, GLuint condition = 0)
+    {
+        Record(key, program, mesh->VAO, mesh->depthVAO, static_cast<GLsizei>(mesh->indexCount), 0, mesh->textureUnits, world, condition);
+    }
+
+    // any indexed range, the terrain chunks and the occlusion boxes are recorded this way
+    void Record(uint64_t key, const Shader* program, GLuint vao, GLuint depthVAO, GLsizei count, size_t first,
+        const unsigned int* textures, const glm::mat4& world, GLuint condition = 0)
+    {
+        DrawItem item;
+        item.key = key;
+        item.program = program;
+        item.vao = vao;
+        item.depthVAO = depthVAO;
+        item.count = count;
+        item.first = first;
+        item.textures = textures;
+        item.drawData = data.size();
+        item.condition = condition;
+        items.push_back(item);
+
+        DrawData block;
+        block.world = world;
+        data.resize(data.size() + Aligned(sizeof(DrawData)));
+        memcpy(&data[item.drawData], &block, sizeof(DrawData));
+    }
+
+    // moves the items of a queue recorded on another thread to the end of this one
+    void Append(const RenderQueue& other)
+    {
+        size_t base = data.size();
+        for (size_t i = 0; i < other.items.size(); i++) {
+            items.push_back(other.items[i]);
+            items.back().drawData += base;
+        }
+        data.insert(data.end(), other.data.begin(), other.data.end());
+    }
+
+    void Clear()
+    {
+        items.clear();
+        sorted.clear();
+        data.clear();
+    }
+
+    // GL thread only: copies the DrawData of every item into this frame's part of the ring buffer.
+    // without a ring, or when it is full, the queue's own buffer is orphaned and refilled instead
+    void Upload(RingBuffer* ring = nullptr)
+    {
+        CountUpload(data.size());
+        if (data.empty())
+            return;
+
+        if (ring && ring->Write(&data[0], data.size(), alignment, dataOffset)) {
+            ring->Flush();
+            dataBuffer = ring->Buffer();
+            return;
+        }
+
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, data.size(), &data[0], GL_STREAM_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        memoryTracker.TrackBuffer(buffer, MEMORY_UNIFORM_BUFFERS, data.size(), "draw data");
+        dataBuffer = buffer;
+        dataOffset = 0;
+    }
+
+    void Release()
+    {
+        if (buffer) {
+            memoryTracker.UntrackBuffer(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+    }
+
+    // binds the DrawData of the i-th recorded item (in recording order), for callers that issue the draw themselves
+    void BindDrawData(size_t i) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, dataBuffer, dataOffset + items[i].drawData, sizeof(DrawData));
+    }
+
+    size_t Size() const
+    {
+        return items.size();
+    }
+
+    // LSD radix sort on the keys, 16 bits per pass. only (key, index) pairs are moved, the items stay in place
+    void Sort()
+    {
+        size_t count = items.size();
+        sorted.resize(count);
+        scratch.resize(count);
+        histogram.resize(1 << 16);
+        for (size_t i = 0; i < count; i++) {
+            sorted[i].key = items[i].key;
+            sorted[i].index = (unsigned int)i;
+        }
+
+        for (int shift = 0; shift < 64; shift += 16) {
+            std::fill(histogram.begin(), histogram.end(), 0u);
+
+            for (size_t i = 0; i < count; i++)
+                histogram[(sorted[i].key >> shift) & 0xFFFF]++;
+
+            // all keys share this digit, nothing to do for this pass
+            if (count == 0 || histogram[(sorted[0].key >> shift) & 0xFFFF] == count)
+                continue;
+
+            unsigned int offset = 0;
+            for (unsigned int d = 0; d < (1 << 16); d++) {
+                unsigned int n = histogram[d];
+                histogram[d] = offset;
+                offset += n;
+            }
+
+            for (size_t i = 0; i < count; i++)
+                scratch[histogram[(sorted[i].key >> shift) & 0xFFFF]++] = sorted[i];
+
+            sorted.swap(scratch);
+        }
+    }
+
+    // draws every item in sorted order, after Sort() and Upload()
+    void Submit()
+    {
+        const Shader* currentProgram = nullptr;
+        GLuint currentVAO = 0;
+        // nothing is known about the units yet, the first item binds all of them
+        unsigned int boundTextures[MESH_TEXTURE_UNITS];
+        for (unsigned int unit = 0; unit < MESH_TEXTURE_UNITS; unit++)
+            boundTextures[unit] = UINT_MAX;
+
+        for (size_t i = 0; i < sorted.size(); i++) {
+            const DrawItem& item = items[sorted[i].index];
+
+            if (item.program != currentProgram) {
+                item.program->Use();
+                currentProgram = item.program;
+            }
+
+            glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, dataBuffer, dataOffset + item.drawData, sizeof(DrawData));
+
+            for (unsigned int unit = 0; item.textures && unit < MESH_TEXTURE_UNITS; unit++) {
+                unsigned int texture = item.textures[unit] ? item.textures[unit] : defaultTextures[unit];
+
+                if (texture != boundTextures[unit]) {
+                    glState.BindTexture(unit, texture);
+                    boundTextures[unit] = texture;
+                }
+            }
+
+            if (item.vao != currentVAO) {
+                glState.BindVertexArray(item.vao);
+                currentVAO = item.vao;
+            }
+
+            Draw(item);
+        }
+    }
+
+    // depth pre-pass: every item with the position-only vertex arrays, no textures, a single program
+    void SubmitDepth(const Shader& program)
+    {
+        program.Use();
+        GLuint currentVAO = 0;
+
+        for (size_t i = 0; i < sorted.size(); i++) {
+            const DrawItem& item = items[sorted[i].index];
+
+            glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_DATA_BINDING, dataBuffer, dataOffset + item.drawData, sizeof(DrawData));
+
+            if (item.depthVAO != currentVAO) {
+                glState.BindVertexArray(item.depthVAO);
+                currentVAO = item.depthVAO;
+            }
+
+            Draw(item);
+        }
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        unsigned int index;
+    };
+
+    unsigned int defaultTextures[MESH_TEXTURE_UNITS];
+
+    vector<DrawItem>  items;
+    vector<SortEntry> sorted;
+    vector<SortEntry> scratch;
+    vector<unsigned int> histogram;
+
+    // DrawData of every item, each padded to the offset alignment
+    vector<unsigned char> data;
+    size_t alignment;
+
+    // fallback buffer, and where the data of this frame ended up
+    GLuint buffer;
+    GLuint dataBuffer;
+    size_t dataOffset;
+
+    size_t Aligned(size_t size) const
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // the GPU drops the draw when the query saw no samples, without waiting if the result isn't there yet
+    static void Draw(const DrawItem& item)
+    {
+        if (item.condition)
+            glBeginConditionalRender(item.condition, GL_QUERY_NO_WAIT);
+
+        glDrawElements(GL_TRIANGLES, item.count, GL_UNSIGNED_INT, (void*)item.first);
+        CountDraw(item.count);
+
+        if (item.condition)
+            glEndConditionalRender();
+    }
+};
+#endif
@@ -0,0 +1,185 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <glad/glad.h>
+
+#include "memorytracker.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// frames that can be writing to or reading from the buffer at the same time
+#define RING_FRAMES 3
+
+// one buffer split into RING_FRAMES regions, frame n writes to region n % RING_FRAMES. allocations are a pointer
+// bump inside the region, the only synchronisation is a fence per region that is waited on when the region
+// comes around again, three frames later.
+//
+// with GL_ARB_buffer_storage the buffer stays mapped (persistent + coherent) and writes go straight to it.
+// without it writes go to a CPU copy and Flush() uploads what was written since the last flush
+class RingBuffer {
+public:
+    struct Stats {
+        size_t used, capacity;
+        unsigned int allocations, overflows;
+        unsigned int waits;
+    };
+
+    Stats stats;
+
+    RingBuffer() : buffer(0), mapped(nullptr), regionSize(0), region(0), head(0), flushed(0), persistent(false)
+    {
+        for (int i = 0; i < RING_FRAMES; i++)
+            fences[i] = 0;
+        stats = Stats();
+    }
+
+    void Create(size_t bytesPerFrame)
+    {
+        regionSize = bytesPerFrame;
+        size_t size = regionSize * RING_FRAMES;
+        persistent = GLAD_GL_ARB_buffer_storage != 0;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (!mapped) {
+                std::cout << "ERROR: could not map the ring buffer, falling back to uploads" << std::endl;
+                persistent = false;
+
+                // the storage is immutable now, start over with a plain buffer
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            }
+        }
+
+        if (!persistent) {
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            shadow.resize(size);
+            mapped = &shadow[0];
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        stats.capacity = regionSize;
+        memoryTracker.TrackBuffer(buffer, MEMORY_UNIFORM_BUFFERS, size, "ring buffer");
+    }
+
+    void Release()
+    {
+        for (int i = 0; i < RING_FRAMES; i++) {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+
+        if (buffer) {
+            if (persistent) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            memoryTracker.UntrackBuffer(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+        shadow.clear();
+    }
+
+    // moves to the next region, waiting only if the GPU is still reading it from RING_FRAMES frames ago
+    void BeginFrame()
+    {
+        region = (region + 1) % RING_FRAMES;
+        head = flushed = region * regionSize;
+
+        if (fences[region]) {
+            GLenum result = glClientWaitSync(fences[region], 0, 0);
+            if (result == GL_TIMEOUT_EXPIRED) {
+                stats.waits++;
+                glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            }
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+
+        stats.used = 0;
+        stats.allocations = 0;
+    }
+
+    // fences everything submitted this frame, the region is reused once it signals
+    void EndFrame()
+    {
+        Flush();
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // bump allocation in this frame's region. returns the byte offset in Buffer() and where to write,
+    // or false when the region is full
+    bool Allocate(size_t size, size_t alignment, size_t& offset, void*& data)
+    {
+        size_t start = (head + alignment - 1) / alignment * alignment;
+        if (start + size > (region + 1) * regionSize) {
+            stats.overflows++;
+            return false;
+        }
+
+        head = start + size;
+        offset = start;
+        data = mapped + start;
+        stats.used = head - region * regionSize;
+        stats.allocations++;
+        return true;
+    }
+
+    // copies into a fresh allocation
+    bool Write(const void* source, size_t size, size_t alignment, size_t& offset)
+    {
+        void* data = nullptr;
+        if (!Allocate(size, alignment, offset, data))
+            return false;
+        memcpy(data, source, size);
+        return true;
+    }
+
+    // makes the writes since the last flush visible to GL, call before drawing with them. nothing to do when persistent
+    void Flush()
+    {
+        if (persistent || head == flushed)
+            return;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, flushed, head - flushed, mapped + flushed);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        flushed = head;
+    }
+
+    GLuint Buffer() const
+    {
+        return buffer;
+    }
+
+    bool Persistent() const
+    {
+        return persistent;
+    }
+
+private:
+    GLuint buffer;
+    unsigned char* mapped;
+    vector<unsigned char> shadow;
+    GLsync fences[RING_FRAMES];
+
+    size_t regionSize;
+    size_t region;
+    size_t head, flushed;
+    bool persistent;
+};
+#endif
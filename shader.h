@@ -0,0 +1,154 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <glad/glad.h>
+
+#include "glstate.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// defined in Graphics Programming.cpp
+void createProgram(GLuint& programID, const char* vertex, const char* fragment, const std::vector<std::string>& defines);
+
+// 32 bit FNV-1a hash of a uniform name
+constexpr uint32_t UniformHash(const char* name, uint32_t hash = 2166136261u)
+{
+    return *name ? UniformHash(name + 1, (hash ^ (uint32_t)(unsigned char)*name) * 16777619u) : hash;
+}
+
+// binding points of the uniform blocks shared between programs
+#define FRAME_DATA_BINDING 0
+#define DRAW_DATA_BINDING 1
+
+// forces the hash to be computed at compile time, use as shader.SetMat4(UNIFORM("view"), view)
+#define UNIFORM(name) std::integral_constant<uint32_t, UniformHash(name)>::value
+
+class Shader {
+public:
+    GLuint ID;
+
+    Shader() : ID(0) {}
+
+    // compiles and links the program with the given #defines, then caches the location of every active uniform
+    void Load(const char* vertex, const char* fragment, const vector<string>& defines = vector<string>())
+    {
+        createProgram(ID, vertex, fragment, defines);
+        Introspect();
+        BindBlock("FrameData", FRAME_DATA_BINDING);
+        BindBlock("DrawData", DRAW_DATA_BINDING);
+    }
+
+    operator GLuint() const
+    {
+        return ID;
+    }
+
+    void Use() const
+    {
+        glState.UseProgram(ID);
+    }
+
+    // cached location for a hashed uniform name, -1 if the uniform is not active in this program
+    GLint Location(uint32_t name) const
+    {
+        vector<UniformSlot>::const_iterator it = std::lower_bound(uniforms.begin(), uniforms.end(), name,
+            [](const UniformSlot& slot, uint32_t hash) { return slot.hash < hash; });
+
+        if (it != uniforms.end() && it->hash == name)
+            return it->location;
+        return -1;
+    }
+
+    // setters expect the program to be in use
+    void SetInt(uint32_t name, int value) const
+    {
+        glUniform1i(Location(name), value);
+        CountUniform();
+    }
+
+    void SetFloat(uint32_t name, float value) const
+    {
+        glUniform1f(Location(name), value);
+        CountUniform();
+    }
+
+    void SetVec3(uint32_t name, const glm::vec3& value) const
+    {
+        glUniform3fv(Location(name), 1, glm::value_ptr(value));
+        CountUniform();
+    }
+
+    void SetMat4(uint32_t name, const glm::mat4& value) const
+    {
+        glUniformMatrix4fv(Location(name), 1, GL_FALSE, glm::value_ptr(value));
+        CountUniform();
+    }
+
+private:
+    struct UniformSlot {
+        uint32_t hash;
+        GLint location;
+    };
+
+    // sorted on hash, filled once after linking
+    vector<UniformSlot> uniforms;
+
+    // attaches a uniform block to a fixed binding point, if the program uses it
+    void BindBlock(const char* name, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+
+    void Introspect()
+    {
+        uniforms.clear();
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        vector<char> name(maxLength + 1);
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+            // arrays are reported as "name[0]", store them under their plain name
+            string uniformName(name.data(), length);
+            size_t bracket = uniformName.find('[');
+            if (bracket != string::npos)
+                uniformName = uniformName.substr(0, bracket);
+
+            // uniforms inside a block have no location
+            GLint location = glGetUniformLocation(ID, name.data());
+            if (location < 0)
+                continue;
+
+            UniformSlot slot;
+            slot.hash = UniformHash(uniformName.c_str());
+            slot.location = location;
+            uniforms.push_back(slot);
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(),
+            [](const UniformSlot& a, const UniformSlot& b) { return a.hash < b.hash; });
+
+        for (size_t i = 1; i < uniforms.size(); i++) {
+            if (uniforms[i].hash == uniforms[i - 1].hash)
+                std::cout << "WARNING: uniform name hash collision in program " << ID << std::endl;
+        }
+    }
+};
+#endif
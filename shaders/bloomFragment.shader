@@ -5,13 +5,34 @@ in vec2 TexCoords;
 uniform sampler2D scene;
 uniform sampler2D bloomBlur;
 
+// the mip chain adds up every level, so the strength is scaled by the number of levels
+uniform float bloomStrength;
+
+// the scene is rendered into the bottom-left uvScale part of its texture and upscaled here,
+// sharpness restores some of the detail lost when rendering below the window resolution
+uniform vec2 uvScale;
+uniform float sharpness;
+
 void main()
 {             
-    vec3 hdrColor = texture(scene, TexCoords).rgb;      
+    vec2 texel = 1.0 / textureSize(scene, 0);
+    vec2 uv = TexCoords * uvScale;
+    vec2 uvMax = uvScale - texel * 0.5;
+    vec3 hdrColor = texture(scene, min(uv, uvMax)).rgb;
+
+    // unsharp mask against the four neighbours
+    if (sharpness > 0.0) {
+        vec3 blur = texture(scene, min(uv + vec2(texel.x, 0.0), uvMax)).rgb;
+        blur += texture(scene, min(uv - vec2(texel.x, 0.0), uvMax)).rgb;
+        blur += texture(scene, min(uv + vec2(0.0, texel.y), uvMax)).rgb;
+        blur += texture(scene, min(uv - vec2(0.0, texel.y), uvMax)).rgb;
+        hdrColor = max(hdrColor + (hdrColor - blur * 0.25) * sharpness, vec3(0.0));
+    }
+
     vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
     
     // additive blending
-    hdrColor = hdrColor + bloomColor * 0.3;
+    hdrColor = hdrColor + bloomColor * bloomStrength;
     
     // tone mapping
     vec3 outputFC = hdrColor / (hdrColor + vec3(1.0));
@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth pre-pass, only the depth written by the rasterizer is kept
+void main()
+{
+}
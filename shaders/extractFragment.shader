@@ -4,17 +4,32 @@ out vec4 FragColor;
 in vec2 TexCoords;
 uniform sampler2D image;
 
+// part of the image that holds the rendered frame, less than 1 when rendering at a lower resolution
+uniform vec2 uvScale;
+
+// keeps the color of pixels above the threshold, black otherwise. taps are kept inside the rendered area.
+// with BRIGHT_INPUT the scene shaders already thresholded the image and it is only downsampled
+vec3 threshold(vec2 uv, vec2 texel) {
+    vec3 color = texture(image, clamp(uv, vec2(0.0), uvScale - texel * 0.5)).rgb;
+#ifdef BRIGHT_INPUT
+    return color;
+#else
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    return brightness > BLOOM_THRESHOLD ? color : vec3(0.0);
+#endif
+}
+
 void main()
 {             
-    vec3 color = texture(image, TexCoords).rgb;
-    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
-    
+    // runs at half resolution, four bilinear taps cover a 4x4 block of the full resolution source
+    vec2 texel = 1.0 / textureSize(image, 0);
+
+    vec2 uv = TexCoords * uvScale;
+
+    vec3 result = threshold(uv + texel * vec2(-1.0, -1.0), texel);
+    result += threshold(uv + texel * vec2( 1.0, -1.0), texel);
+    result += threshold(uv + texel * vec2(-1.0,  1.0), texel);
+    result += threshold(uv + texel * vec2( 1.0,  1.0), texel);
 
-    //treshold
-    if (brightness > 0.3) {
-        FragColor = vec4(color, 1.0);
-    }
-    else {
-        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
-    }
-}
\ No newline at end of file
+    FragColor = vec4(result * 0.25, 1.0);
+}
@@ -1,10 +0,0 @@
-#version 330 core
-layout (location = 0) in vec3 aPos;
-
-out vec2 fragCoord;
-
-void main()
-{
-	gl_Position = vec4(aPos, 1.0);
-	fragCoord = (gl_Position.xy / gl_Position.w) * .5 + .5;
-}
\ No newline at end of file
@@ -1,6 +1,10 @@
 #version 330 core
 layout(location = 0) out vec4 FragColor;
+
+// the thresholded second target is only written in the MRT bloom mode
+#ifdef BRIGHT_OUTPUT
 layout(location = 1) out vec4 BrightColor;
+#endif
 in vec2 TexCoords;
 in vec3 Normals;
 in vec4 FragPos;
@@ -10,8 +14,20 @@ uniform sampler2D texture_specular1;
 uniform sampler2D texture_normal1;
 uniform sampler2D texture_roughness1;
 uniform sampler2D texture_ao1;
-uniform vec3 cameraPosition;
-uniform vec3 lightDirection;
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 lightDirection;
+    vec3 cameraPosition;
+};
+
+// fog starts at FOG_START units from the camera and is fully opaque FOG_RANGE units later, NO_FOG removes it
+#ifndef FOG_START
+#define FOG_START 250.0
+#endif
+#ifndef FOG_RANGE
+#define FOG_RANGE 1000.0
+#endif
 
 vec4 lerp(vec4 a, vec4 b, float t) {
     return a + (b - a) * t;
@@ -42,25 +58,30 @@ void main()
 
     vec3 lighting = diffuse.rgb * (light * 1.0 + 0.01) + specular;
     
-
+#ifndef NO_FOG
     vec3 topColor = vec3(68.0 / 255.0, 118.0 / 255.0, 189.0 / 255.0);
     vec3 botColor = vec3(188.0 / 255.0, 214.0 / 255.0, 231.0 / 255.0);
     float dist = length(FragPos.xyz - cameraPosition);
-    float fog = pow( clamp((dist - 250) / 1000, 0, 1), 2);
+    float fog = pow( clamp((dist - FOG_START) / FOG_RANGE, 0, 1), 2);
     vec3 fogColor = lerp(botColor, topColor, max(viewDir.y, 0.0));
     
     vec4 outputFC = vec4(lerp(lighting, fogColor, fog), diffuse.a);
+#else
+    vec4 outputFC = vec4(lighting, diffuse.a);
+#endif
     
 
     FragColor = outputFC;
     
 
+#ifdef BRIGHT_OUTPUT
     vec3 finalColor = outputFC.rgb;
     float brightness = dot(finalColor, vec3(0.2126, 0.7152, 0.0722));
     
     // treshold
-    if(brightness > 0.3) 
+    if(brightness > BLOOM_THRESHOLD) 
         BrightColor = vec4(finalColor, 1.0);
     else
         BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
 }
\ No newline at end of file
@@ -7,16 +7,30 @@ out vec2 TexCoords;
 out vec3 Normals;
 out vec4 FragPos;
 
-uniform mat4 world;
-uniform mat4 view;
-uniform mat4 projection;
+// the depth pre-pass (DEPTH_ONLY) must produce bit-identical depth for the GL_EQUAL test in the main pass
+invariant gl_Position;
+
+// per-draw data, the range of the render queue's uniform buffer that belongs to this draw
+layout(std140) uniform DrawData {
+    mat4 world;
+};
+
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 lightDirection;
+    vec3 cameraPosition;
+};
 
 void main()
 {
-    TexCoords = aTexCoords;
     FragPos = world * vec4(aPos, 1.0);
     gl_Position = projection * view * FragPos;
 
+#ifndef DEPTH_ONLY
+    TexCoords = aTexCoords;
+
     // not the most efficient, but it works
     Normals = normalize( mat3(inverse(transpose(world)))* aNormal );
+#endif
 }
\ No newline at end of file
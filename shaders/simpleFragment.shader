@@ -10,7 +10,13 @@
  uniform sampler2D normalTex;
 
  uniform vec3 lightPosition;
- uniform vec3 cameraPosition;
+
+ layout(std140) uniform FrameData {
+     mat4 view;
+     mat4 projection;
+     vec3 lightDirection;
+     vec3 cameraPosition;
+ };
 
 
  void main()
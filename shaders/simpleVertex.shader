@@ -12,7 +12,14 @@ layout(location = 5) in vec3 vBitangent;
  out vec3 worldPosition;
 
 
- uniform mat4 world, view, projection;
+ uniform mat4 world;
+
+ layout(std140) uniform FrameData {
+     mat4 view;
+     mat4 projection;
+     vec3 lightDirection;
+     vec3 cameraPosition;
+ };
  uniform vec3 lightPosition;
 
 
@@ -1,13 +1,26 @@
 #version 330 core
-layout(location = 0) in vec3 aPos;
-layout(location = 3) in vec3 vNormal;
 
-out vec4 worldPosition;
-uniform mat4 world, view, projection;
+// far plane point under this pixel, minus the camera position
+out vec3 viewRay;
+
+uniform mat4 inverseViewProjection;
+
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 lightDirection;
+    vec3 cameraPosition;
+};
 
 
 void main() 
 {
-	gl_Position = projection * view * world * vec4(aPos, 1.0);
-	worldPosition = world * vec4(aPos, 1.0);
-}
\ No newline at end of file
+	// one triangle covering the screen, generated from the vertex id so no vertex buffer is needed
+	vec2 ndc = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+
+	// at the far plane, so the depth test only lets it through where nothing else was drawn
+	gl_Position = vec4(ndc, 1.0, 1.0);
+
+	vec4 farPoint = inverseViewProjection * vec4(ndc, 1.0, 1.0);
+	viewRay = farPoint.xyz / farPoint.w - cameraPosition;
+}
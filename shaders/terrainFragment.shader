@@ -1,18 +1,44 @@
 #version 330 core
 layout(location = 0) out vec4 FragColor;
+
+// the thresholded second target is only written in the MRT bloom mode
+#ifdef BRIGHT_OUTPUT
 layout(location = 1) out vec4 BrightColor;
+#endif
 in vec2 uv;
 in vec3 worldPosition;
 uniform sampler2D mainTex;
 uniform sampler2D normalTex;
 uniform sampler2D dirt, sand, grass, rock, snow;
-uniform vec3 lightDirection;
-uniform vec3 cameraPosition;
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 lightDirection;
+    vec3 cameraPosition;
+};
+
+// fog starts at FOG_START units from the camera and is fully opaque FOG_RANGE units later, NO_FOG removes it
+#ifndef FOG_START
+#define FOG_START 250.0
+#endif
+#ifndef FOG_RANGE
+#define FOG_RANGE 1000.0
+#endif
+
+// number of height layers blended, from 1 (dirt only) to 5 (dirt, sand, grass, rock, snow)
+#ifndef TERRAIN_LAYERS
+#define TERRAIN_LAYERS 5
+#endif
 
 vec3 lerp(vec3 a, vec3 b, float t) {
     return a + (b - a) * t;
 }
 
+// close and far tiling of a layer texture, blended on distance
+vec3 layerColor(sampler2D tex, float uvLerp) {
+    return lerp(texture(tex, uv * 100).rgb, texture(tex, uv * 10).rgb, uvLerp);
+}
+
 void main()
 {
     // normal Map
@@ -40,39 +66,40 @@ void main()
     float dist = length(worldPosition.xyz - cameraPosition);
     float uvLerp = clamp((dist - 250) / 150, -1, 1) * .5 + .5;
     
-    vec3 dirtColorClose = texture(dirt, uv * 100).rgb;
-    vec3 sandColorClose = texture(sand, uv * 100).rgb;
-    vec3 grassColorClose = texture(grass, uv * 100).rgb;
-    vec3 rockColorClose = texture(rock, uv * 100).rgb;
-    vec3 snowColorClose = texture(snow, uv * 100).rgb;
-    
-    vec3 dirtColorFar = texture(dirt, uv * 10).rgb;
-    vec3 sandColorFar = texture(sand, uv * 10).rgb;
-    vec3 grassColorFar = texture(grass, uv * 10).rgb;
-    vec3 rockColorFar = texture(rock, uv * 10).rgb;
-    vec3 snowColorFar = texture(snow, uv * 10).rgb;
-    
-    vec3 dirtColor = lerp(dirtColorClose, dirtColorFar, uvLerp);
-    vec3 sandColor = lerp(sandColorClose, sandColorFar, uvLerp);
-    vec3 grassColor = lerp(grassColorClose, grassColorFar, uvLerp);
-    vec3 rockColor = lerp(rockColorClose, rockColorFar, uvLerp);
-    vec3 snowColor = lerp(snowColorClose, snowColorFar, uvLerp);
-    
-    vec3 diffuse = lerp(lerp(lerp(lerp(dirtColor, sandColor, ds), grassColor, sg), rockColor, gr), snowColor, rs);
+    // layers that are not compiled in are never sampled
+    vec3 diffuse = layerColor(dirt, uvLerp);
+#if TERRAIN_LAYERS > 1
+    diffuse = lerp(diffuse, layerColor(sand, uvLerp), ds);
+#endif
+#if TERRAIN_LAYERS > 2
+    diffuse = lerp(diffuse, layerColor(grass, uvLerp), sg);
+#endif
+#if TERRAIN_LAYERS > 3
+    diffuse = lerp(diffuse, layerColor(rock, uvLerp), gr);
+#endif
+#if TERRAIN_LAYERS > 4
+    diffuse = lerp(diffuse, layerColor(snow, uvLerp), rs);
+#endif
     
-    float fog = pow(clamp((dist - 250) / 1000, 0, 1), 2);
+#ifndef NO_FOG
+    float fog = pow(clamp((dist - FOG_START) / FOG_RANGE, 0, 1), 2);
     vec3 topColor = vec3(68.0 / 255.0, 118.0 / 255.0, 189.0 / 255.0);
     vec3 botColor = vec3(188.0 / 255.0, 214.0 / 255.0, 231.0 / 255.0);
     vec3 fogColor = (lerp(botColor, topColor, max(viewDir.y, 0.0)));
     
     vec3 finalColor = lerp(diffuse * min(lightValue + 0.01, 1.0), fogColor, fog);
+#else
+    vec3 finalColor = diffuse * min(lightValue + 0.01, 1.0);
+#endif
     FragColor = vec4(finalColor, 1.0);
 
+#ifdef BRIGHT_OUTPUT
     float brightness = dot(finalColor, vec3(0.2126, 0.7152, 0.0722));
 
     //treshold
-    if(brightness > 0.3)
+    if(brightness > BLOOM_THRESHOLD)
         BrightColor = vec4(finalColor, 1.0);
     else
         BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
 }
\ No newline at end of file
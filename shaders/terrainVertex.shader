@@ -6,7 +6,20 @@ layout(location = 2) in vec2 vUV;
 out vec2 uv;
 out vec3 worldPosition;
 
-uniform mat4 world, view, projection;
+// the depth pre-pass (DEPTH_ONLY) must produce bit-identical depth for the GL_EQUAL test in the main pass
+invariant gl_Position;
+
+// per-draw data, the range of the render queue's uniform buffer that belongs to this draw
+layout(std140) uniform DrawData {
+    mat4 world;
+};
+
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 lightDirection;
+    vec3 cameraPosition;
+};
 
 uniform sampler2D mainTex;
 
@@ -19,7 +32,10 @@ void main() {
 	worldPos.y += texture(mainTex, vUV).r * 100.0f;
 
 	gl_Position = projection * view * worldPos;
+
+#ifndef DEPTH_ONLY
 	uv = vUV;
 
 	worldPosition = mat3(world) * aPos;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// one level down in the mip chain, half the size of the target
+uniform sampler2D image;
+
+// spread of the tent filter in source texels
+uniform float radius;
+
+void main()
+{
+    vec2 offset = radius / textureSize(image, 0);
+
+    // 3x3 tent filter, the result is added on top of the target with blending
+    vec3 result = texture(image, TexCoords).rgb * 4.0;
+
+    result += texture(image, TexCoords + vec2(-offset.x, 0.0)).rgb * 2.0;
+    result += texture(image, TexCoords + vec2( offset.x, 0.0)).rgb * 2.0;
+    result += texture(image, TexCoords + vec2(0.0, -offset.y)).rgb * 2.0;
+    result += texture(image, TexCoords + vec2(0.0,  offset.y)).rgb * 2.0;
+
+    result += texture(image, TexCoords + vec2(-offset.x, -offset.y)).rgb;
+    result += texture(image, TexCoords + vec2( offset.x, -offset.y)).rgb;
+    result += texture(image, TexCoords + vec2(-offset.x,  offset.y)).rgb;
+    result += texture(image, TexCoords + vec2( offset.x,  offset.y)).rgb;
+
+    FragColor = vec4(result / 16.0, 1.0);
+}
@@ -0,0 +1,388 @@
+#ifndef SOFTWAREOCCLUSION_H
+#define SOFTWAREOCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// 8 pixels per instruction with AVX2, 4 with SSE2 (always there on x64), one at a time otherwise.
+// OCCLUSION_NO_AVX2 and OCCLUSION_SCALAR force a narrower path, the test builds every path this way
+#if defined(__AVX2__) && !defined(OCCLUSION_NO_AVX2) && !defined(OCCLUSION_SCALAR)
+#include <immintrin.h>
+#define OCCLUSION_AVX2
+#elif (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(OCCLUSION_SCALAR)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2
+#endif
+
+#include "threadpool.h"
+
+using namespace std;
+
+// the depth buffer is stored in 8x8 pixel tiles, a tile row of 8 floats is one SIMD register (or two)
+#define OCCLUSION_TILE 8
+
+// CPU occlusion culling. occluders are rasterized into a small depth buffer with SIMD coverage masks,
+// then bounding boxes are tested against it. nothing in here touches OpenGL, so it runs headless.
+//
+// usage per frame: Clear(), SetViewProjection(), AddOccluder() for each occluder, Rasterize(),
+// then IsVisible() for every candidate. depth is window depth in [0, 1], 1 is the far plane.
+class SoftwareOcclusion {
+public:
+    // IsVisible may be called from several threads at once, hence the atomics
+    struct Stats {
+        unsigned int triangles;
+        std::atomic<unsigned int> tested, culled;
+    };
+
+    Stats stats;
+
+    SoftwareOcclusion(int width = 256, int height = 144) : pool(nullptr), viewProjection(1.0f)
+    {
+        Resize(width, height);
+        Clear();
+    }
+
+    // rounded up to whole tiles
+    void Resize(int w, int h)
+    {
+        tilesX = (w + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+        tilesY = (h + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+        width = tilesX * OCCLUSION_TILE;
+        height = tilesY * OCCLUSION_TILE;
+        depth.assign((size_t)width * height, 1.0f);
+        tileMax.assign((size_t)tilesX * tilesY, 1.0f);
+    }
+
+    // rasterization is split over tile rows on the pool, or done on the calling thread without one
+    void SetPool(ThreadPool* threads)
+    {
+        pool = threads;
+    }
+
+    void Clear()
+    {
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        std::fill(tileMax.begin(), tileMax.end(), 1.0f);
+        triangles.clear();
+        stats.triangles = 0;
+        stats.tested = 0;
+        stats.culled = 0;
+    }
+
+    void SetViewProjection(const glm::mat4& vp)
+    {
+        viewProjection = vp;
+    }
+
+    // queues the triangles of an occluder. positions point at the first x, stride is the distance in bytes
+    // between two positions, so interleaved vertex arrays can be passed directly
+    void AddOccluder(const float* positions, size_t stride, size_t vertexCount, const unsigned int* indices, size_t indexCount, const glm::mat4& world)
+    {
+        glm::mat4 toClip = viewProjection * world;
+
+        clipped.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            const float* p = (const float*)((const char*)positions + i * stride);
+            clipped[i] = toClip * glm::vec4(p[0], p[1], p[2], 1.0f);
+        }
+
+        for (size_t i = 0; i + 2 < indexCount; i += 3)
+            AddClipTriangle(clipped[indices[i]], clipped[indices[i + 1]], clipped[indices[i + 2]]);
+    }
+
+    // fills the depth buffer with every queued triangle
+    void Rasterize()
+    {
+        stats.triangles = (unsigned int)triangles.size();
+
+        if (pool) {
+            pool->ParallelFor((unsigned int)tilesY, [this](unsigned int row) { RasterizeTileRow((int)row); });
+        }
+        else {
+            for (int row = 0; row < tilesY; row++)
+                RasterizeTileRow(row);
+        }
+    }
+
+    // false only when every pixel the box covers has an occluder in front of the nearest box corner
+    bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world)
+    {
+        stats.tested++;
+        glm::mat4 toClip = viewProjection * world;
+
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x, (i & 2) ? boundsMax.y : boundsMin.y, (i & 4) ? boundsMax.z : boundsMin.z);
+            glm::vec4 clip = toClip * glm::vec4(corner, 1.0f);
+
+            // crosses the near plane, the box is around or right in front of the camera
+            if (clip.w <= NEAR_W)
+                return true;
+
+            glm::vec3 screen = ToScreen(clip);
+            minX = std::min(minX, screen.x);
+            maxX = std::max(maxX, screen.x);
+            minY = std::min(minY, screen.y);
+            maxY = std::max(maxY, screen.y);
+            minZ = std::min(minZ, screen.z);
+        }
+
+        // pixel centers inside the box rectangle
+        int x0 = std::max((int)std::ceil(minX - 0.5f), 0);
+        int x1 = std::min((int)std::floor(maxX - 0.5f), width - 1);
+        int y0 = std::max((int)std::ceil(minY - 0.5f), 0);
+        int y1 = std::min((int)std::floor(maxY - 0.5f), height - 1);
+
+        // off screen, or too small to cover a pixel center
+        if (x0 > x1 || y0 > y1) {
+            if (maxX < 0.0f || maxY < 0.0f || minX > width || minY > height || minZ > 1.0f) {
+                stats.culled++;
+                return false;
+            }
+            return true;
+        }
+
+        for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ty++) {
+            for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; tx++) {
+                // everything in the tile is closer than the box
+                if (tileMax[ty * tilesX + tx] < minZ)
+                    continue;
+
+                if (TileVisible(tx, ty, x0, x1, y0, y1, minZ))
+                    return true;
+            }
+        }
+
+        stats.culled++;
+        return false;
+    }
+
+    // depth at a pixel, for debugging and tests
+    float Depth(int x, int y) const
+    {
+        return depth[PixelIndex(x, y)];
+    }
+
+    int Width() const
+    {
+        return width;
+    }
+
+    int Height() const
+    {
+        return height;
+    }
+
+private:
+    struct ScreenTriangle {
+        // edge functions a * x + b * y + c, positive inside
+        float a[3], b[3], c[3];
+
+        // depth plane z = zx * x + zy * y + zc
+        float zx, zy, zc;
+
+        // pixel bounds
+        int x0, x1, y0, y1;
+    };
+
+    // triangles are clipped against w = NEAR_W instead of the real near plane, close enough and never divides by zero
+    static constexpr float NEAR_W = 0.001f;
+
+    int width, height, tilesX, tilesY;
+    vector<float> depth;
+    vector<float> tileMax;
+    vector<ScreenTriangle> triangles;
+    vector<glm::vec4> clipped;
+    ThreadPool* pool;
+    glm::mat4 viewProjection;
+
+    size_t PixelIndex(int x, int y) const
+    {
+        int tile = (y / OCCLUSION_TILE) * tilesX + (x / OCCLUSION_TILE);
+        return (size_t)tile * OCCLUSION_TILE * OCCLUSION_TILE + (y % OCCLUSION_TILE) * OCCLUSION_TILE + (x % OCCLUSION_TILE);
+    }
+
+    // window coordinates, y up like OpenGL, depth in [0, 1]
+    glm::vec3 ToScreen(const glm::vec4& clip) const
+    {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f);
+    }
+
+    // cuts the part behind the near plane off, leaving one or two triangles
+    void AddClipTriangle(const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2)
+    {
+        const glm::vec4 in[3] = { v0, v1, v2 };
+        glm::vec4 out[4];
+        int count = 0;
+
+        for (int i = 0; i < 3; i++) {
+            const glm::vec4& a = in[i];
+            const glm::vec4& b = in[(i + 1) % 3];
+            bool aInside = a.w > NEAR_W;
+            bool bInside = b.w > NEAR_W;
+
+            if (aInside)
+                out[count++] = a;
+            if (aInside != bInside) {
+                float t = (NEAR_W - a.w) / (b.w - a.w);
+                out[count++] = a + (b - a) * t;
+            }
+        }
+
+        for (int i = 1; i + 1 < count; i++)
+            AddScreenTriangle(ToScreen(out[0]), ToScreen(out[i]), ToScreen(out[i + 1]));
+    }
+
+    void AddScreenTriangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+    {
+        float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+        if (std::fabs(area) < 1e-6f)
+            return;
+
+        // both windings occlude, flip the clockwise ones so inside is always positive
+        if (area < 0.0f) {
+            std::swap(p1, p2);
+            area = -area;
+        }
+
+        ScreenTriangle t;
+        t.x0 = std::max((int)std::ceil(std::min(p0.x, std::min(p1.x, p2.x)) - 0.5f), 0);
+        t.x1 = std::min((int)std::floor(std::max(p0.x, std::max(p1.x, p2.x)) - 0.5f), width - 1);
+        t.y0 = std::max((int)std::ceil(std::min(p0.y, std::min(p1.y, p2.y)) - 0.5f), 0);
+        t.y1 = std::min((int)std::floor(std::max(p0.y, std::max(p1.y, p2.y)) - 0.5f), height - 1);
+        if (t.x0 > t.x1 || t.y0 > t.y1)
+            return;
+
+        // nothing behind the far plane can hide anything
+        if (std::min(p0.z, std::min(p1.z, p2.z)) > 1.0f)
+            return;
+
+        const glm::vec3* p[3] = { &p0, &p1, &p2 };
+        for (int e = 0; e < 3; e++) {
+            const glm::vec3& a = *p[e];
+            const glm::vec3& b = *p[(e + 1) % 3];
+            t.a[e] = a.y - b.y;
+            t.b[e] = b.x - a.x;
+            t.c[e] = a.x * b.y - a.y * b.x;
+        }
+
+        t.zx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) / area;
+        t.zy = ((p2.z - p0.z) * (p1.x - p0.x) - (p1.z - p0.z) * (p2.x - p0.x)) / area;
+        t.zc = p0.z - t.zx * p0.x - t.zy * p0.y;
+
+        triangles.push_back(t);
+    }
+
+    // one row of tiles, rows never share pixels so they can run in parallel
+    void RasterizeTileRow(int ty)
+    {
+        int rowY0 = ty * OCCLUSION_TILE;
+        int rowY1 = rowY0 + OCCLUSION_TILE - 1;
+
+        for (size_t i = 0; i < triangles.size(); i++) {
+            const ScreenTriangle& t = triangles[i];
+            if (t.y1 < rowY0 || t.y0 > rowY1)
+                continue;
+
+            int y0 = std::max(t.y0, rowY0);
+            int y1 = std::min(t.y1, rowY1);
+            for (int tx = t.x0 / OCCLUSION_TILE; tx <= t.x1 / OCCLUSION_TILE; tx++) {
+                float* tile = &depth[(size_t)(ty * tilesX + tx) * OCCLUSION_TILE * OCCLUSION_TILE];
+                for (int y = y0; y <= y1; y++)
+                    RasterizeRow(t, tile + (y - rowY0) * OCCLUSION_TILE, tx * OCCLUSION_TILE, y);
+            }
+        }
+
+        for (int tx = 0; tx < tilesX; tx++) {
+            const float* tile = &depth[(size_t)(ty * tilesX + tx) * OCCLUSION_TILE * OCCLUSION_TILE];
+            tileMax[ty * tilesX + tx] = *std::max_element(tile, tile + OCCLUSION_TILE * OCCLUSION_TILE);
+        }
+    }
+
+    // 8 pixels of a tile row: coverage mask from the three edge functions, then a masked depth min
+    void RasterizeRow(const ScreenTriangle& t, float* row, int x, int y) const
+    {
+        float py = y + 0.5f;
+
+#if defined(OCCLUSION_AVX2)
+        __m256 px = _mm256_add_ps(_mm256_set1_ps(x + 0.5f), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 zero = _mm256_setzero_ps();
+        __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int e = 0; e < 3; e++) {
+            __m256 edge = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.a[e]), px), _mm256_set1_ps(t.b[e] * py + t.c[e]));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(edge, zero, _CMP_GE_OQ));
+        }
+        if (_mm256_movemask_ps(mask) == 0)
+            return;
+
+        __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.zx), px), _mm256_set1_ps(t.zy * py + t.zc));
+        __m256 d = _mm256_loadu_ps(row);
+        _mm256_storeu_ps(row, _mm256_blendv_ps(d, _mm256_min_ps(d, z), mask));
+#elif defined(OCCLUSION_SSE2)
+        for (int half = 0; half < OCCLUSION_TILE; half += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps(x + half + 0.5f), _mm_setr_ps(0, 1, 2, 3));
+            __m128 zero = _mm_setzero_ps();
+            __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int e = 0; e < 3; e++) {
+                __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[e]), px), _mm_set1_ps(t.b[e] * py + t.c[e]));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(edge, zero));
+            }
+            if (_mm_movemask_ps(mask) == 0)
+                continue;
+
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.zx), px), _mm_set1_ps(t.zy * py + t.zc));
+            __m128 d = _mm_loadu_ps(row + half);
+            __m128 nearer = _mm_min_ps(d, z);
+            _mm_storeu_ps(row + half, _mm_or_ps(_mm_and_ps(mask, nearer), _mm_andnot_ps(mask, d)));
+        }
+#else
+        for (int i = 0; i < OCCLUSION_TILE; i++) {
+            float px = x + i + 0.5f;
+            bool inside = true;
+            for (int e = 0; e < 3; e++)
+                inside = inside && (t.a[e] * px + t.b[e] * py + t.c[e] >= 0.0f);
+
+            if (inside)
+                row[i] = std::min(row[i], t.zx * px + t.zy * py + t.zc);
+        }
+#endif
+    }
+
+    // any pixel of the tile inside the box rectangle that is not in front of minZ
+    bool TileVisible(int tx, int ty, int x0, int x1, int y0, int y1, float minZ) const
+    {
+        const float* tile = &depth[(size_t)(ty * tilesX + tx) * OCCLUSION_TILE * OCCLUSION_TILE];
+        int tileX = tx * OCCLUSION_TILE, tileY = ty * OCCLUSION_TILE;
+
+        // columns of the tile inside [x0, x1] as a bit mask
+        int from = std::max(x0 - tileX, 0), to = std::min(x1 - tileX, OCCLUSION_TILE - 1);
+        int columns = ((1 << (to + 1)) - 1) & ~((1 << from) - 1);
+
+        for (int y = std::max(y0 - tileY, 0); y <= std::min(y1 - tileY, OCCLUSION_TILE - 1); y++) {
+            const float* row = tile + y * OCCLUSION_TILE;
+
+#if defined(OCCLUSION_AVX2)
+            int visible = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row), _mm256_set1_ps(minZ), _CMP_GE_OQ));
+#elif defined(OCCLUSION_SSE2)
+            __m128 z = _mm_set1_ps(minZ);
+            int visible = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row), z)) |
+                (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + 4), z)) << 4);
+#else
+            int visible = 0;
+            for (int i = 0; i < OCCLUSION_TILE; i++)
+                visible |= (row[i] >= minZ) << i;
+#endif
+            if (visible & columns)
+                return true;
+        }
+        return false;
+    }
+};
+#endif
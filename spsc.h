@@ -0,0 +1,92 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <atomic>
+#include <cstddef>
+using namespace std;
+
+// lock-free queue between exactly one producer thread and one consumer thread.
+// Capacity must be a power of two, one slot is kept free to tell full from empty
+template <typename T, size_t Capacity>
+class SPSCQueue {
+public:
+    SPSCQueue() : head(0), tail(0)
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+    }
+
+    // producer only, false when the queue is full and the item was dropped
+    bool Push(const T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t next = (h + 1) & (Capacity - 1);
+        if (next == tail.load(std::memory_order_acquire))
+            return false;
+
+        slots[h] = item;
+        head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only, false when there is nothing to take
+    bool Pop(T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+
+        item = slots[t];
+        tail.store((t + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[Capacity];
+
+    // on separate cache lines, each is written by one side only
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+// latest-value mailbox between one writer and one reader. the writer never waits for the reader and the
+// reader always gets the newest complete value, values in between are skipped
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : back(0), ready(1), front(2) {}
+
+    // writer only, the slot to fill before calling Publish()
+    T& Back()
+    {
+        return slots[back & INDEX];
+    }
+
+    void Publish()
+    {
+        back = ready.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // reader only, swaps in the newest published value if there is one and returns the current front
+    const T& Read()
+    {
+        if (ready.load(std::memory_order_relaxed) & FRESH)
+            front = ready.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return slots[front];
+    }
+
+    // reader only, true when something was published after the last Read()
+    bool Fresh() const
+    {
+        return (ready.load(std::memory_order_relaxed) & FRESH) != 0;
+    }
+
+private:
+    static const unsigned int INDEX = 3;
+    static const unsigned int FRESH = 4;
+
+    T slots[3];
+    unsigned int back;
+    std::atomic<unsigned int> ready;
+    unsigned int front;
+};
+#endif
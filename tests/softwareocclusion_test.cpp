@@ -0,0 +1,172 @@
+// SoftwareOcclusion without a GL context. built once per SIMD path (see CMakeLists.txt), every build has to
+// give the same answers as the scalar one, which are the ones below
+#include "softwareocclusion.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstring>
+#include <iostream>
+
+#if defined(OCCLUSION_AVX2)
+#define OCCLUSION_PATH "avx2"
+#elif defined(OCCLUSION_SSE2)
+#define OCCLUSION_PATH "sse2"
+#else
+#define OCCLUSION_PATH "scalar"
+#endif
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cout << "FAIL: " << #condition << " (line " << __LINE__ << ")" << std::endl; \
+            failures++; \
+        } \
+    } while (0)
+
+// camera at the origin looking down -z, 90 degrees so a point at depth d is on the screen edge at x = +-d
+static const int SIZE = 64;
+static const glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), 1.0f, 1.0f, 100.0f);
+
+// two triangles from (x0, y0) to (x1, y1), at z0 on the near edge and z1 on the far edge
+static void addQuad(SoftwareOcclusion& occlusion, float x0, float y0, float z0, float x1, float y1, float z1)
+{
+    const float positions[] = {
+        x0, y0, z0,
+        x1, y0, z0,
+        x1, y1, z1,
+        x0, y1, z1
+    };
+    const unsigned int indices[] = { 0, 1, 2, 0, 2, 3 };
+    occlusion.AddOccluder(positions, 3 * sizeof(float), 4, indices, 6, glm::mat4(1.0f));
+}
+
+static bool visible(SoftwareOcclusion& occlusion, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    return occlusion.IsVisible(boundsMin, boundsMax, glm::mat4(1.0f));
+}
+
+// a wall facing the camera at depth 10, x and y in [-5, 5], covers pixels 16 to 47 in both directions
+static void testWall(ThreadPool* pool)
+{
+    SoftwareOcclusion occlusion(SIZE, SIZE);
+    occlusion.SetPool(pool);
+    occlusion.SetViewProjection(viewProjection);
+    addQuad(occlusion, -5.0f, -5.0f, -10.0f, 5.0f, 5.0f, -10.0f);
+    occlusion.Rasterize();
+    CHECK(occlusion.stats.triangles == 2);
+
+    int covered = 0;
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            bool inside = x >= 16 && x < 48 && y >= 16 && y < 48;
+            covered += occlusion.Depth(x, y) < 1.0f;
+            if (inside != (occlusion.Depth(x, y) < 1.0f)) {
+                std::cout << "FAIL: coverage at " << x << ", " << y << std::endl;
+                failures++;
+                return;
+            }
+        }
+    }
+    CHECK(covered == 32 * 32);
+
+    glm::vec4 center = viewProjection * glm::vec4(0.0f, 0.0f, -10.0f, 1.0f);
+    CHECK(std::fabs(occlusion.Depth(32, 32) - (center.z / center.w * 0.5f + 0.5f)) < 1e-5f);
+
+    // behind the wall, in its shadow
+    CHECK(!visible(occlusion, glm::vec3(-1.0f, -1.0f, -21.0f), glm::vec3(1.0f, 1.0f, -19.0f)));
+    // in front of the wall
+    CHECK(visible(occlusion, glm::vec3(-1.0f, -1.0f, -6.0f), glm::vec3(1.0f, 1.0f, -4.0f)));
+    // behind the wall, but half of it sticks out to the right
+    CHECK(visible(occlusion, glm::vec3(8.0f, -1.0f, -22.0f), glm::vec3(12.0f, 1.0f, -18.0f)));
+    // behind the wall and next to it
+    CHECK(visible(occlusion, glm::vec3(13.0f, -1.0f, -21.0f), glm::vec3(15.0f, 1.0f, -19.0f)));
+    // crosses the near plane, mostly behind the wall
+    CHECK(visible(occlusion, glm::vec3(-1.0f, -1.0f, -30.0f), glm::vec3(1.0f, 1.0f, 1.0f)));
+    // entirely off screen
+    CHECK(!visible(occlusion, glm::vec3(-1.0f, 40.0f, -21.0f), glm::vec3(1.0f, 42.0f, -19.0f)));
+    CHECK(occlusion.stats.tested == 6);
+    CHECK(occlusion.stats.culled == 2);
+}
+
+// a floor one unit below the camera from behind it to depth 50, has to be clipped at the near plane
+static void testNearPlane(ThreadPool* pool)
+{
+    SoftwareOcclusion occlusion(SIZE, SIZE);
+    occlusion.SetPool(pool);
+    occlusion.SetViewProjection(viewProjection);
+    addQuad(occlusion, -100.0f, -1.0f, 10.0f, 100.0f, -1.0f, -50.0f);
+    occlusion.Rasterize();
+
+    // the clipped part is split in two triangles per quad triangle at most
+    CHECK(occlusion.stats.triangles >= 2 && occlusion.stats.triangles <= 4);
+
+    // the floor fills the bottom of the screen up to its far edge at y = -1 / 50, nothing above it
+    for (int x = 0; x < SIZE; x++) {
+        CHECK(occlusion.Depth(x, 0) < 1.0f);
+        CHECK(occlusion.Depth(x, 30) < 1.0f);
+        CHECK(occlusion.Depth(x, 32) == 1.0f);
+        CHECK(occlusion.Depth(x, SIZE - 1) == 1.0f);
+    }
+
+    // under the floor
+    CHECK(!visible(occlusion, glm::vec3(-1.0f, -6.0f, -21.0f), glm::vec3(1.0f, -4.0f, -19.0f)));
+    // on top of the floor
+    CHECK(visible(occlusion, glm::vec3(-1.0f, -1.0f, -21.0f), glm::vec3(1.0f, 1.0f, -19.0f)));
+}
+
+// IsVisible only looks at the tile maxima when a whole tile is in front, and at the pixels otherwise
+static void testPartialTiles(ThreadPool* pool)
+{
+    SoftwareOcclusion occlusion(SIZE, SIZE);
+    occlusion.SetPool(pool);
+    occlusion.SetViewProjection(viewProjection);
+
+    // x in [-5, 5.3125] at depth 10 covers pixels 16 to 48, one column into the next tile
+    addQuad(occlusion, -5.0f, -5.0f, -10.0f, 5.3125f, 5.0f, -10.0f);
+    occlusion.Rasterize();
+    CHECK(occlusion.Depth(48, 32) < 1.0f);
+    CHECK(occlusion.Depth(49, 32) == 1.0f);
+
+    // covers pixels 40 to 49 behind the wall, the last column is not occluded
+    CHECK(visible(occlusion, glm::vec3(5.0f, -1.0f, -21.0f), glm::vec3(11.5f, 1.0f, -20.0f)));
+    // pixels 40 to 48
+    CHECK(!visible(occlusion, glm::vec3(5.0f, -1.0f, -21.0f), glm::vec3(10.6f, 1.0f, -20.0f)));
+}
+
+int main()
+{
+    std::cout << "software occlusion, " << OCCLUSION_PATH << " path" << std::endl;
+
+#ifdef OCCLUSION_TEST_PATH
+    // the build asked for this path, make sure the header picked it
+    if (strcmp(OCCLUSION_TEST_PATH, OCCLUSION_PATH) != 0) {
+        std::cout << "FAIL: built for " << OCCLUSION_TEST_PATH << std::endl;
+        return 1;
+    }
+#endif
+
+#if defined(OCCLUSION_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    if (!__builtin_cpu_supports("avx2")) {
+        std::cout << "skipped, the CPU has no AVX2" << std::endl;
+        return 77;
+    }
+#endif
+
+    // on the calling thread, then split over tile rows
+    ThreadPool pool(3);
+    ThreadPool* pools[] = { nullptr, &pool };
+    for (int i = 0; i < 2; i++) {
+        testWall(pools[i]);
+        testNearPlane(pools[i]);
+        testPartialTiles(pools[i]);
+    }
+
+    if (failures) {
+        std::cout << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "passed" << std::endl;
+    return 0;
+}
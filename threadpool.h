@@ -0,0 +1,113 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "profiler.h"
+
+// fixed set of worker threads for data parallel loops, the calling thread helps out while it waits
+class ThreadPool {
+public:
+    // 0 uses one thread less than the hardware has, the calling thread is the last one
+    ThreadPool(unsigned int threads = 0) : job(nullptr), count(0), generation(0), pending(0), stop(false)
+    {
+        if (threads == 0) {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            threads = hardware > 1 ? hardware - 1 : 1;
+        }
+
+        for (unsigned int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&ThreadPool::Work, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned int Size() const
+    {
+        return (unsigned int)workers.size() + 1;
+    }
+
+    // runs job(i) for every i in [0, n) spread over the threads, returns when all of them are done
+    void ParallelFor(unsigned int n, const std::function<void(unsigned int)>& f)
+    {
+        if (n == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &f;
+            count = n;
+            next = 0;
+            pending = (unsigned int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        Drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        job = nullptr;
+    }
+
+private:
+    vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    const std::function<void(unsigned int)>* job;
+    unsigned int count;
+    std::atomic<unsigned int> next;
+    unsigned int generation;
+    unsigned int pending;
+    bool stop;
+
+    // takes indices until there are none left
+    void Drain()
+    {
+        for (unsigned int i = next++; i < count; i = next++)
+            (*job)(i);
+    }
+
+    void Work()
+    {
+        Profiler::SetThreadName("worker");
+
+        unsigned int seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+
+            Drain();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+            done.notify_one();
+        }
+    }
+};
+#endif